@@ -1,33 +1,593 @@
 #!/usr/bin/env python3
 
+import argparse
+import atexit
+import os
+import sys
+from pathlib import Path
+
 from phases.check_requirements import require_root
 from phases.check_requirements import ensure_dependencies
 from phases.check_requirements import checkUEFI
 
+from phases import library
 from phases.library import run_command
 from phases.library import confirm
 
+from phases.config import config_argv
+from phases.config import load_config
+from phases.config import validate_config
+
+from phases.fleet import CONTROLLER_PORT
+from phases.fleet import ProgressReporter
+from phases.fleet import local_host_id
+from phases.fleet import request_config
+from phases.fleet import serve_controller
+
+from phases.fdisk_setup import activate_swap
+from phases.fdisk_setup import create_subvolumes
+from phases.fdisk_setup import discard_disk
+from phases.fdisk_setup import enable_swap
+from phases.fdisk_setup import format_efi
+from phases.fdisk_setup import format_root
 from phases.fdisk_setup import list_disks
-from phases.fdisk_setup import run_fdisk
+from phases.fdisk_setup import mount_target
+from phases.fdisk_setup import partition_disk
+from phases.fdisk_setup import confirm_wipe
+from phases.fdisk_setup import release_target
+from phases.fdisk_setup import remount_target
+from phases.fdisk_setup import select_disks
 
-from phases.base_install import base_install
 from phases.base_install import chroot_config
+from phases.base_install import configure_dkms_jobs
+from phases.base_install import generate_fstab
+from phases.base_install import init_keyring
+from phases.base_install import pacstrap_target
+from phases.base_install import refresh_sync_db
+
+from phases.mirrors import update_mirrorlist
+
+from phases.lan_cache import discover_lan_cache
+from phases.lan_cache import remove_lan_cache
+from phases.lan_cache import serve_cache
+from phases.lan_cache import use_lan_cache
 from phases.user_inputs import prompt_user_inputs
+from phases.packages import DEFAULT_PROFILE
+from phases.packages import MANIFEST_PATH
+from phases.packages import get_profile
+from phases.packages import load_manifest
+from phases.packages import needs_dkms
+from phases.packages import gpu_options
+from phases.packages import profile_wants_gpu_prompt
+from phases.packages import resolve_packages
+
+from phases.package_cache import HOST_CACHE_DIR
+from phases.package_cache import TARGET_MIRRORLIST
+from phases.package_cache import TARGET_PACMAN_CONF
+from phases.package_cache import configure_host_cache
+from phases.package_cache import enable_parallel_downloads
+from phases.package_cache import seed_cache
+
+from phases.disk_layout import PROFILE_MIN_DEVICES
+from phases.disk_layout import LayoutPlan
+from phases.disk_layout import plan_layout
+from phases.disk_layout import probe_disk
+from phases.disk_layout import GIB
+from phases.disk_layout import ram_bytes
+from phases.disk_layout import swap_size_bytes
+
+from phases.mount_layout import DEFAULT_LAYOUT
+from phases.mount_layout import LAYOUTS_PATH
+from phases.mount_layout import MountLayout
+from phases.mount_layout import load_layout
+
+from phases.swap import SWAPFILE
+from phases.swap import SWAP_STRATEGIES
+from phases.swap import check_swap_strategy
+from phases.swap import configure_zram
+from phases.swap import create_swapfile
+from phases.swap import describe_swap
+from phases.swap import resume_kernel_args
+from phases.swap import swap_layout
+
+from phases.snapshots import configure_snapshots
+
+from phases.tuning import DEFAULT_TUNING
+from phases.tuning import TUNING_PROFILES
+from phases.tuning import configure_tuning
+from phases.tuning import get_tuning
+from phases.tuning import record_tuning
+from phases.tuning import tuning_packages
+from phases.tuning import tuning_services
+
+from phases.preflight import Preflight
+from phases.preflight import predict_install
+from phases.preflight import run_preflight
+
+from phases.reprovision import check_reprovision
+from phases.reprovision import snapshot_root
+from phases.reprovision import sync_packages
+
+from phases.staging import STAGE_DIR
+from phases.staging import STAGE_MODES
+from phases.staging import copy_stage
+from phases.staging import mount_stage
+from phases.staging import release_stage
+from phases.staging import stage_mode
+
+from phases.boot import BOOTLOADERS
+from phases.boot import INITRAMFS_COMPRESSION
+from phases.boot import boot_services
+
+from phases.hardware import hardware_summary
+from phases.hardware import microcode_package
+
+from phases.report import REPORT
+
+from phases.events import DEFAULT_LOG_PATH
+from phases.events import EVENTS
+
+from phases.benchmark import GPU_TOOLS
+from phases.benchmark import HOST_TOOLS
+from phases.benchmark import run_benchmarks
+
+from phases.image_deploy import extract_image
+from phases.image_deploy import is_btrfs_image
+from phases.image_deploy import receive_image
+
+from phases.report import DEFAULT_REPORT_PATH
+from phases.report import print_summary
+from phases.report import write_report
+
+from phases.state import Checkpoint
+from phases.state import load_checkpoint
+from phases.state import state_mount
+
+from phases.scheduler import Task
+from phases.scheduler import run_tasks
+
+def parse_args(argv: list[str] | None = None) -> argparse.Namespace:
+    parser = argparse.ArgumentParser(description="Arch Linux Installer (btrfs + hyprland)")
+    parser.add_argument("--config", metavar="PATH|URL|-",
+                        help="Unattended install: JSON file or http(s) URL with disks, users, locale, GPU "
+                             "and any option below; nothing is prompted")
+    parser.add_argument("--fleet", type=Path, metavar="PATH",
+                        help="Do not install; run the fleet controller that hands configs from PATH to installers")
+    parser.add_argument("--controller-port", type=int, default=CONTROLLER_PORT, metavar="PORT",
+                        help=f"Port used by --fleet (default: {CONTROLLER_PORT})")
+    parser.add_argument("--controller", metavar="URL",
+                        help="Unattended install with the config a --fleet controller hands out for this host")
+    parser.add_argument("--controller-token", metavar="TOKEN", default=os.environ.get("INSTALLER_CONTROLLER_TOKEN"),
+                        help="The fleet file's \"token\", sent with every --controller request "
+                             "(default: $INSTALLER_CONTROLLER_TOKEN)")
+    parser.add_argument("--host-id", metavar="ID",
+                        help="Id to ask the controller for (default: MAC address of the first network interface)")
+    parser.add_argument("--parallel-downloads", type=int, default=0, metavar="N",
+                        help="Enable pacman ParallelDownloads with N concurrent downloads on host and target")
+    parser.add_argument("--cache-dir", type=Path,
+                        help="Shared package cache used by pacstrap and the chroot pacman step (e.g. USB or NFS mount)")
+    parser.add_argument("--cache-seed", type=Path,
+                        help="Directory of packages to copy into --cache-dir before installing")
+    parser.add_argument("--manifest", type=Path, default=MANIFEST_PATH,
+                        help="Package manifest with named profiles (default: packages.json next to main.py)")
+    parser.add_argument("--profile", default=DEFAULT_PROFILE,
+                        help=f"Package profile to install (default: {DEFAULT_PROFILE})")
+    parser.add_argument("--mirror-probes", type=int, default=20, metavar="N",
+                        help="Rate-test only the N most recently synced mirrors (default: 20)")
+    parser.add_argument("--mirror-timeout", type=int, default=3, metavar="SECONDS",
+                        help="Connection/download timeout for each mirror probe (default: 3)")
+    parser.add_argument("--mirror-cache", type=Path,
+                        help="Saved mirrorlist to reuse across runs, e.g. on a shared NFS path")
+    parser.add_argument("--mirror-ttl", type=float, default=6, metavar="HOURS",
+                        help="Reuse --mirror-cache if younger than this (default: 6, 0 always re-ranks)")
+    parser.add_argument("--serve-cache", action="store_true",
+                        help="Do not install; serve --cache-dir over HTTP as a caching mirror for other installs")
+    parser.add_argument("--serve-port", type=int, default=7878, metavar="PORT",
+                        help="Port used by --serve-cache (default: 7878)")
+    parser.add_argument("--lan-cache", metavar="URL|auto",
+                        help="Put a --serve-cache host first in the mirrorlist; 'auto' listens for its LAN broadcast")
+    parser.add_argument("--image", metavar="PATH|URL",
+                        help="Deploy a prebuilt root instead of pacstrap: a btrfs send stream (*.btrfs[.zst]) "
+                             "received as @/@var, or a root tarball (*.tar[.zst]) unpacked into /mnt")
+    parser.add_argument("--report", type=Path, default=DEFAULT_REPORT_PATH,
+                        help=f"JSON timing report path (default: {DEFAULT_REPORT_PATH}); also copied to the target's /var/log/installer")
+    parser.add_argument("--retries", type=int, default=3, metavar="N",
+                        help="Retry pacman -Syy and pacstrap N times with backoff, moving to the next mirror each time (default: 3)")
+    parser.add_argument("--resume", action="store_true",
+                        help="Continue an interrupted install: remount the existing subvolumes and skip completed steps")
+    parser.add_argument("--reprovision", action="store_true",
+                        help="Refresh an earlier install on the same drive(s) without wiping: snapshot @ and @var, "
+                             "sync the packages to the profile and redo the configuration; @home is kept")
+    parser.add_argument("--swap", choices=SWAP_STRATEGIES, default="partition",
+                        help="Swap strategy: a partition, a btrfs swapfile in a nodatacow @swap subvolume, "
+                             "zram-generator, or none (default: partition)")
+    parser.add_argument("--hibernate", action="store_true",
+                        help="Size disk swap to hold a hibernation image (RAM + sqrt(RAM)) and set up resume")
+    parser.add_argument("--efi-size", type=int, default=256, metavar="MiB",
+                        help="EFI system partition size (default: 256)")
+    parser.add_argument("--swap-size", type=float, metavar="GiB",
+                        help="Swap partition or swapfile size instead of the RAM-based default; 0 for no swap")
+    parser.add_argument("--discard", action="store_true",
+                        help="blkdiscard every target drive, all at once, before partitioning (reused SSDs)")
+    parser.add_argument("--data-profile", choices=sorted(PROFILE_MIN_DEVICES),
+                        help="btrfs data profile; defaults to raid0 when several drives are given")
+    parser.add_argument("--metadata-profile", choices=sorted(PROFILE_MIN_DEVICES),
+                        help="btrfs metadata profile; defaults to raid1 when several drives are given")
+    parser.add_argument("--layout",
+                        help="Subvolume/mount layout from --layout-file (default: the profile's layout, else standard)")
+    parser.add_argument("--layout-file", type=Path, default=LAYOUTS_PATH,
+                        help="Mount layouts file (default: layouts.json next to main.py)")
+    parser.add_argument("--stage", choices=STAGE_MODES, default="off",
+                        help="pacstrap into a tmpfs or zram-backed directory and copy the result to the disk in "
+                             "one stream; auto does so for rotational/USB targets with enough RAM (default: off)")
+    parser.add_argument("--no-preflight", action="store_true",
+                        help="Skip the pre-flight check of disk space, cache space, staging RAM, mirror and disk speed")
+    parser.add_argument("--plan-only", action="store_true",
+                        help="Print the partition plan and sfdisk script for the chosen disk, then exit")
+    parser.add_argument("--gpu", metavar="auto|none|GROUP|0-4",
+                        help="Override the profile's GPU driver: detect it, none, a gpu-* manifest group or a menu number")
+    parser.add_argument("--fast-boot", action="store_true",
+                        help="systemd-based initramfs hooks, no fallback image and a 1s boot menu timeout")
+    parser.add_argument("--initramfs-compression", choices=INITRAMFS_COMPRESSION, default="zstd",
+                        help="initramfs compression with --fast-boot (default: zstd; lz4 decompresses faster)")
+    parser.add_argument("--bootloader", choices=BOOTLOADERS, default="grub",
+                        help="grub (default), systemd-boot with one entry per kernel, or systemd-boot with UKIs")
+    parser.add_argument("--tuning", choices=list(TUNING_PROFILES),
+                        help="Performance profile of the installed system: kernel, I/O schedulers, vm sysctls, "
+                             f"CPU power management (default: the package profile's \"tuning\", else {DEFAULT_TUNING})")
+    parser.add_argument("--kernel", metavar="PACKAGE",
+                        help="Kernel to install instead of linux, one of the manifest's \"kernels\" "
+                             "(default: the tuning profile's)")
+    parser.add_argument("--irqbalance", action="store_true",
+                        help="Install and enable irqbalance (the throughput tuning profile always does)")
+    parser.add_argument("--log-file", type=Path, default=DEFAULT_LOG_PATH,
+                        help=f"JSON lines event log: phases, command output, downloads (default: {DEFAULT_LOG_PATH})")
+    parser.add_argument("--log-stream", metavar="tcp://HOST:PORT|URL",
+                        help="Also stream the events to a TCP log collector or POST them in batches to an HTTP URL")
+    parser.add_argument("--quiet", action="store_true",
+                        help="Keep command output off the console (it still goes to --log-file); "
+                             "the last lines of a failing command are shown")
+    parser.add_argument("--benchmark", action="store_true",
+                        help="Benchmark the installed system (fio per subvolume, compression, pacman DB, "
+                             "first-boot systemd-analyze and GPU checks) into the install report")
+    parser.add_argument("--jobs", type=int, default=4, metavar="N",
+                        help="Maximum number of install steps run at the same time (default: 4, 1 runs strictly in order)")
+    return parser.parse_args(argv)
+
+def configure_target_pacman(parallel_downloads: int) -> None:
+    enable_parallel_downloads(parallel_downloads, TARGET_PACMAN_CONF)
+    # pacstrap copies the host mirrorlist; the LAN cache is only for the install itself
+    remove_lan_cache(TARGET_MIRRORLIST)
+
+def setup_lan_cache(lan_cache: str) -> None:
+    url = discover_lan_cache() if lan_cache == "auto" else lan_cache
+    if url is None:
+        print("No LAN package cache answered, using the public mirrors only.")
+        return
+    use_lan_cache(url)
+
+def mirror_tasks(args: argparse.Namespace, country: str) -> tuple[list[Task], list[str]]:
+    """Rank the host mirrors (and add the LAN cache); also returns the tasks after which the list is final."""
+    tasks = [
+        Task("mirrors", lambda: update_mirrorlist(country, max_mirrors=args.mirror_probes,
+                                                  probe_timeout=args.mirror_timeout,
+                                                  cache_path=args.mirror_cache, ttl_hours=args.mirror_ttl),
+             checkpoint=False),
+    ]
+    final = ["mirrors"]
+    if args.lan_cache is not None:
+        tasks.append(Task("lan-cache", lambda: setup_lan_cache(args.lan_cache), after=["mirrors"], checkpoint=False))
+        final.append("lan-cache")
+    return tasks, final
+
+def disk_tasks(plan: LayoutPlan, discard: bool = False) -> list[Task]:
+    """Partition and format; every drive is discarded in its own task, and EFI, swap
+    and the btrfs root are formatted side by side once the tables are written."""
+    efi, swap, root = plan.partition_path("efi"), plan.partition_path("swap"), plan.partition_path("root")
+    tasks = []
+    if discard:
+        # Default arguments bind each drive; a bare lambda would see only the last one
+        tasks += [Task(f"discard-{disk_plan.disk.name}", lambda disk=disk_plan.disk: discard_disk(disk))
+                  for disk_plan in plan.all_disks()]
+    tasks += [
+        Task("partition", lambda: partition_disk(plan), after=[task.name for task in tasks]),
+        Task("mkfs-efi", lambda: format_efi(efi), after=["partition"]),
+        Task("mkfs-root", lambda: format_root(plan.root_devices(), plan.data_profile, plan.metadata_profile, discard),
+             after=["partition"]),
+    ]
+    if swap is not None:
+        tasks.append(Task("swap", lambda: enable_swap(swap), after=["partition"]))
+    return tasks
+
+def pacstrap_tasks(args: argparse.Namespace, plan: LayoutPlan, layout: MountLayout, country: str,
+                   packages: list[str], stage: str = "off", preflight: Preflight | None = None) -> list[Task]:
+    """Build the root with pacstrap; the task named "root" finishes once /mnt holds a full system.
+
+    With a stage, pacstrap writes to RAM while the disk is still being prepared, and
+    "root" copies the result onto the mounted layout.
+    """
+    efi, root = plan.partition_path("efi"), plan.partition_path("root")
+    # Disk work and network/keyring work share no state until pacstrap, so the
+    # scheduler overlaps them and pacstrap waits only for what it needs
+    tasks = disk_tasks(plan, args.discard) + [
+        Task("subvolumes", lambda: create_subvolumes(root, layout), after=["mkfs-root"]),
+        Task("mount", lambda: mount_target(efi, root, layout), after=["subvolumes", "mkfs-efi"]),
+        Task("keyring", init_keyring, checkpoint=False),
+    ]
+    mirrors, mirrors_done = mirror_tasks(args, country)
+    tasks += mirrors
+    tasks.append(Task("sync-db", lambda: refresh_sync_db(args.retries), after=mirrors_done, checkpoint=False))
+    if preflight is not None:
+        # Samples the mirror pacstrap will actually use; nothing waits for it
+        tasks.append(Task("preflight-rate", lambda: predict_install(preflight, plan), after=mirrors_done,
+                          checkpoint=False))
+    staged = stage != "off"
+    target = STAGE_DIR if staged else "/mnt"
+    pacstrap_after = ["sync-db", "keyring"]
+    if staged:
+        # The stage only lives in RAM, so it is rebuilt rather than checkpointed
+        tasks.append(Task("stage", lambda: mount_stage(stage, ram_bytes()), checkpoint=False))
+        pacstrap_after.append("stage")
+        base_after = "stage"
+    else:
+        pacstrap_after.append("mount")
+        base_after = "mount"
+    if args.cache_seed is not None:
+        tasks.append(Task("seed-cache", lambda: seed_cache(args.cache_seed, args.cache_dir),
+                          checkpoint=False))
+        pacstrap_after.append("seed-cache")
+    if needs_dkms(packages):
+        tasks.append(Task("dkms-jobs", lambda: configure_dkms_jobs(target), after=[base_after],
+                          checkpoint=not staged))
+        pacstrap_after.append("dkms-jobs")
+    pacstrap = lambda: pacstrap_target(packages, use_host_cache=args.cache_dir is not None,
+                                       retries=args.retries, root=target)
+    if staged:
+        tasks += [
+            Task("pacstrap", pacstrap, after=pacstrap_after, checkpoint=False),
+            Task("root", copy_stage, after=["pacstrap", "mount"]),
+        ]
+    else:
+        tasks.append(Task("root", pacstrap, after=pacstrap_after))
+    return tasks
+
+def reprovision_tasks(args: argparse.Namespace, plan: LayoutPlan, layout: MountLayout, country: str,
+                      packages: list[str]) -> list[Task]:
+    """Refresh an earlier install in place: no partitioning or mkfs, @home and data subvolumes are kept."""
+    efi, swap, root = plan.partition_path("efi"), plan.partition_path("swap"), plan.partition_path("root")
+    tasks = [
+        Task("snapshot", lambda: snapshot_root(root)),
+        # Subvolumes the layout gained since the original install
+        Task("subvolumes", lambda: create_subvolumes(root, layout), after=["snapshot"]),
+        Task("mount", lambda: mount_target(efi, root, layout), after=["subvolumes"]),
+    ]
+    mirrors, mirrors_done = mirror_tasks(args, country)
+    tasks += mirrors
+    if swap is not None:
+        tasks.append(Task("swap", lambda: activate_swap(swap)))
+    sync_after = ["mount", *mirrors_done]
+    if needs_dkms(packages):
+        tasks.append(Task("dkms-jobs", configure_dkms_jobs, after=["mount"]))
+        sync_after.append("dkms-jobs")
+    tasks.append(Task("root", lambda: sync_packages(packages, args.cache_dir), after=sync_after))
+    return tasks
+
+def image_tasks(image: str, plan: LayoutPlan, layout: MountLayout, discard: bool = False) -> list[Task]:
+    """Deploy a prebuilt root; no mirrors, keyring or package downloads are involved."""
+    efi, root = plan.partition_path("efi"), plan.partition_path("root")
+    tasks = disk_tasks(plan, discard)
+    if is_btrfs_image(image):
+        tasks += [
+            Task("receive", lambda: receive_image(root, image, layout), after=["mkfs-root"]),
+            Task("subvolumes", lambda: create_subvolumes(root, layout), after=["receive"]),
+            Task("root", lambda: mount_target(efi, root, layout), after=["subvolumes", "mkfs-efi"]),
+        ]
+    else:
+        tasks += [
+            Task("subvolumes", lambda: create_subvolumes(root, layout), after=["mkfs-root"]),
+            Task("mount", lambda: mount_target(efi, root, layout), after=["subvolumes", "mkfs-efi"]),
+            Task("root", lambda: extract_image(image), after=["mount"]),
+        ]
+    return tasks
 
 def main() -> None:
+    args = parse_args()
+    if args.fleet is not None:
+        serve_controller(args.fleet, args.controller_port)
+        return
+
+    config = None
+    reporter = None
+    if args.controller is not None:
+        if not args.controller_token:
+            print("Error: --controller needs --controller-token (or $INSTALLER_CONTROLLER_TOKEN).")
+            sys.exit(1)
+        host_id = args.host_id or local_host_id()
+        config = request_config(args.controller, host_id, args.controller_token)
+        reporter = ProgressReporter(args.controller, host_id, args.controller_token)
+    elif args.config is not None:
+        config = load_config(args.config)
+    if config is not None:
+        # Config options first, so anything also given on the command line overrides them
+        args = parse_args(config_argv(config) + sys.argv[1:])
+        library.UNATTENDED = True
+
+    if args.serve_cache:
+        serve_cache(args.cache_dir or HOST_CACHE_DIR, args.serve_port)
+        return
+
+    # Command output goes through a background writer from here on, so a slow
+    # console or log collector never holds up the install
+    EVENTS.start(args.log_file, args.log_stream, quiet=args.quiet)
+    atexit.register(EVENTS.close)
+    # Commands now run in their own process groups, out of reach of the terminal's Ctrl-C
+    library.forward_interrupts()
     
     checkUEFI()
     require_root()
-    ensure_dependencies()
-    
-    country, username, host_name, user_pass, root_pass, timezone, gpu = prompt_user_inputs()
+    ensure_dependencies((["zstd", "curl", "tar"] if args.image else []) + (["blkdiscard"] if args.discard else [])
+                        + (HOST_TOOLS if args.benchmark else []))
+
+    manifest = load_manifest(args.manifest)
+    profile = get_profile(manifest, args.profile)
+    tuning_name = args.tuning or profile.get("tuning", DEFAULT_TUNING)
+    tuning = get_tuning(tuning_name)
+    if args.image is not None and args.kernel is not None:
+        print("Error: --kernel cannot be used with --image; the image brings its own kernel.")
+        sys.exit(1)
+    if args.cache_seed is not None and args.cache_dir is None:
+        # pacstrap only reads a --cache-dir; seeding the ISO's RAM-backed cache saves nothing
+        print("Error: --cache-seed needs --cache-dir to seed.")
+        sys.exit(1)
+    # An image keeps its kernel; the rest of the tuning profile still applies
+    kernel = (args.kernel or tuning.kernel or "linux") if args.image is None else None
+
+    settings = None
+    if config is not None:
+        settings = validate_config(config, gpu_options(manifest), require_wipe=not args.reprovision)
+        names = settings.disks
+    else:
+        list_disks()
+        names = select_disks()
+    name = names[0]
+    check_swap_strategy(args.swap, args.hibernate, args.swap_size, len(names) > 1)
+    if args.reprovision and (args.image is not None or args.resume or args.discard):
+        print("Error: --reprovision cannot be combined with --image, --resume or --discard.")
+        sys.exit(1)
+    ram = ram_bytes()
+    plan = plan_layout(probe_disk(name), ram, hibernate=args.hibernate,
+                       efi_mib=args.efi_size, swap_gib=args.swap_size if args.swap == "partition" else 0,
+                       members=[probe_disk(member) for member in names[1:]],
+                       data_profile=args.data_profile, metadata_profile=args.metadata_profile)
+    layout = load_layout(args.layout or profile.get("layout", DEFAULT_LAYOUT), plan.disk.rotational, args.layout_file)
+    layout = swap_layout(layout, args.swap)
+    swap = plan.partition_path("swap") if args.swap == "partition" else None
+    if args.swap == "swapfile":
+        swap = "/mnt" + SWAPFILE
+        swap_bytes = int(args.swap_size * GIB) if args.swap_size is not None else swap_size_bytes(ram, args.hibernate)
+    else:
+        swap_bytes = plan.partition("swap").size if swap is not None else 0
+    if swap_bytes == 0 and args.swap in {"partition", "swapfile"}:
+        args.swap = "none"
+    stage = stage_mode(args.stage, plan.disk, ram) if args.image is None and not args.reprovision else "off"
+    if args.plan_only:
+        print(plan.describe())
+        print(layout.describe())
+        print(describe_swap(args.swap, swap_bytes, args.hibernate))
+        print(f"pacstrap staging: {stage}")
+        print(f"Tuning: {tuning_name} ({tuning.description})")
+        print(f"\nsfdisk script:\n{plan.sfdisk_script()}")
+        return
+    if settings is not None:
+        country, username, host_name = settings.country, settings.username, settings.hostname
+        user_pass, root_pass, timezone, gpu = settings.user_pass, settings.root_pass, settings.timezone, settings.gpu
+    else:
+        country, username, host_name, user_pass, root_pass, timezone, gpu = prompt_user_inputs(
+            ask_gpu=profile_wants_gpu_prompt(profile) and args.image is None and args.gpu is None)
+    if args.gpu is not None:
+        if args.gpu not in gpu_options(manifest):
+            print(f"Error: --gpu must be one of {', '.join(gpu_options(manifest))}.")
+            sys.exit(1)
+        gpu = args.gpu
+    REPORT.extra["hardware"] = hardware_summary()
+    packages = resolve_packages(manifest, profile, gpu, kernel)
+    # Per-host packages; an image gets them in the chroot step if it lacks them
+    host_packages = [package for package in [microcode_package(),
+                                             "zram-generator" if args.swap == "zram" else None] if package]
+    if args.benchmark:
+        host_packages += GPU_TOOLS
+    host_packages += tuning_packages(tuning, args.irqbalance)
+    record_tuning(tuning_name, tuning, kernel or "image", args.swap, args.irqbalance)
+    if args.image is None:
+        packages += host_packages
+
+    preflight = None
+    if args.reprovision:
+        missing = check_reprovision(plan.partition_path("root"), layout)
+        print(f"\n{layout.describe()}")
+        if missing:
+            print(f"New subvolumes: {', '.join(missing)}")
+        if not confirm(f"Reprovision {plan.partition_path('root')} to profile '{args.profile}'? @ and @var are "
+                       f"snapshotted first, packages outside the profile are removed, @home is kept.",
+                       unattended=True if settings is not None else None):
+            print("Aborted.")
+            sys.exit(0)
+    elif not args.resume:
+        if args.image is None and not args.no_preflight:
+            preflight = run_preflight(packages, plan, stage, args.stage, args.cache_dir, HOST_CACHE_DIR,
+                                      swap_bytes if args.swap == "swapfile" else 0, ram, args.retries)
+            stage = preflight.stage
+        print(f"\n{layout.describe()}\n{describe_swap(args.swap, swap_bytes, args.hibernate)}")
+        # validate_config already required "wipe": true
+        confirm_wipe(plan, unattended=True if settings is not None else None)
+
+    enable_parallel_downloads(args.parallel_downloads)
+    if args.cache_dir is not None:
+        configure_host_cache(args.cache_dir)
+
+    mode = "image" if args.image is not None else "reprovision" if args.reprovision else "pacstrap"
+    holder = state_mount([subvolume.target for subvolume in layout.subvolumes])
+    if args.resume:
+        remount_target(plan.partition_path("efi"), swap, plan.partition_path("root"), layout)
+        checkpoint = load_checkpoint(mode, name, holder)
+    else:
+        checkpoint = Checkpoint(mode, name, state_mount=holder)
+
+    if args.image is not None:
+        tasks = image_tasks(args.image, plan, layout, args.discard)
+    elif args.reprovision:
+        tasks = reprovision_tasks(args, plan, layout, country, packages)
+    else:
+        tasks = pacstrap_tasks(args, plan, layout, country, packages, stage, preflight)
+        REPORT.extra["stage"] = stage
+    fstab_after, chroot_after = ["root"], ["fstab", "target-pacman-conf"]
+    if args.swap == "swapfile":
+        # Active before genfstab so the swapfile lands in fstab
+        tasks.append(Task("swapfile", lambda: create_swapfile(swap_bytes), after=["root"]))
+        fstab_after.append("swapfile")
+    elif args.swap == "zram":
+        tasks.append(Task("zram", configure_zram, after=["root"]))
+        chroot_after.append("zram")
+    # Unit files, udev rules and sysctls only; the chroot's services step enables the units
+    tasks.append(Task("tuning", lambda: configure_tuning(tuning, args.swap), after=["root"]))
+    chroot_after.append("tuning")
+    tasks += [
+        Task("fstab", generate_fstab, after=fstab_after),
+        Task("target-pacman-conf", lambda: configure_target_pacman(args.parallel_downloads), after=["root"]),
+        # Needs the snapper package's template and sysconfig, so it runs once the system exists
+        Task("snapshots", lambda: configure_snapshots(layout), after=["root"]),
+        Task("chroot", lambda: chroot_config(username, host_name, user_pass, root_pass, timezone,
+                                             boot_services(profile.get("services", []), args.bootloader)
+                                             + tuning_services(tuning, args.irqbalance),
+                                             from_image=args.image is not None,
+                                             multi_device=bool(plan.members),
+                                             resume_args=resume_kernel_args(args.swap, swap, plan.partition_path("root"))
+                                             if args.hibernate else None,
+                                             extra_packages=host_packages if args.image else None,
+                                             makepkg=profile.get("makepkg"),
+                                             bootloader=args.bootloader, fast_boot=args.fast_boot,
+                                             initramfs_compression=args.initramfs_compression,
+                                             root=plan.partition_path("root")),
+             after=chroot_after),
+    ]
+    if args.benchmark:
+        tasks.append(Task("benchmark", lambda: run_benchmarks(layout), after=["chroot"]))
+    ok = False
+    try:
+        run_tasks(tasks, max_workers=args.jobs, completed=set(checkpoint.completed), on_done=checkpoint.mark)
+        ok = True
+    finally:
+        print_summary()
+        write_report(args.report, ok)
+        EVENTS.close()
+        if reporter is not None:
+            reporter.finish(ok)
+        # After the report and event log were copied to the target
+        release_stage()
+        release_target(swap)
 
-    list_disks()
-    run_fdisk()
-    base_install(country)
-    chroot_config(username, host_name, user_pass, root_pass, timezone, gpu)
-    if confirm("Do you want to reboot?"):
+    if confirm("Do you want to reboot?", unattended=settings is not None and settings.reboot):
         run_command(["reboot"])
 
 if __name__ == "__main__":
-    main()
\ No newline at end of file
+    main()
@@ -3,27 +3,45 @@ import subprocess
 import sys
 from pathlib import Path
 
-from .library import confirm
+from .boot import bootloader_script
+from .boot import initramfs_script
+from .boot import kernel_cmdline
+from .chroot import ChrootSession
 from .library import run_command
 from .library import write_file
+from .mirrors import rotate_mirrorlist
 
-def base_install(country: str):
+# A few MiB of databases; a mirror that stalls halfway is retried on the next one
+SYNC_DB_TIMEOUT = 300
+# pacman-key blocks on entropy in freshly booted VMs; fail rather than hang forever
+KEYRING_TIMEOUT = 600
 
-    try:
-        subprocess.run(["reflector", "-c", country, "--sort", "rate", "--save", "/etc/pacman.d/mirrorlist"], check=True)
-        print("Mirrorlist updated successfully")
-    except (subprocess.CalledProcessError, FileNotFoundError) as e:
-        print(f" Warning: Failed to update mirrorlist with reflector: {e}")
-        print("This could affect download speeds, but the installation can continue.")
-        if not confirm("Do you want to continue with the installation?"):
-            print("Aborted.")
-            sys.exit(0)
-        print("Continuing with installation...")
-    run_command(["pacman", "-Syy"])
-    run_command(["pacman-key", "--init"])
-    run_command(["pacman-key", "--populate"])
-    run_command(["pacstrap", "/mnt", "base", "linux", "linux-firmware", "nano", "neovim", "sof-firmware", "base-devel", "grub", "grub-btrfs", "efibootmgr", "networkmanager", "snapper"])
-    # Generate fstab and write to file
+def refresh_sync_db(retries: int = 0) -> None:
+    run_command(["pacman", "-Syy"], retries=retries, before_retry=rotate_mirrorlist, timeout=SYNC_DB_TIMEOUT)
+
+def init_keyring() -> None:
+    run_command(["pacman-key", "--init"], timeout=KEYRING_TIMEOUT)
+    run_command(["pacman-key", "--populate"], timeout=KEYRING_TIMEOUT)
+
+def pacstrap_target(packages: list[str], use_host_cache: bool = False, retries: int = 0, root: str = "/mnt") -> None:
+    # -c makes pacstrap use the host cache instead of a fresh one on the target
+    pacstrap_flags = ["-c"] if use_host_cache else []
+    # One transaction for the whole system: a single dependency resolution and
+    # one run of the dkms/mkinitcpio hooks at the end
+    # pacman downloads everything before extracting, so a failed download can be retried in place
+    run_command(["pacstrap", *pacstrap_flags, root, *packages], retries=retries, before_retry=rotate_mirrorlist)
+
+# dkms sources this file; the driver build otherwise compiles on a single core.
+# Kept on the target so kernel updates rebuild in parallel too.
+DKMS_JOBS_CONF = """parallel_jobs=$(nproc)
+export MAKEFLAGS="-j$(nproc)"
+"""
+
+def configure_dkms_jobs(root: str = "/mnt") -> None:
+    # Written before pacstrap so the single dkms run at the end of the transaction picks it up
+    write_file(Path(root) / "etc/dkms/framework.conf.d/parallel.conf", DKMS_JOBS_CONF, mode=0o644)
+
+def generate_fstab() -> None:
     try:
         result = subprocess.run(["genfstab", "-U", "/mnt"], check=True, capture_output=True, text=True)
         etc_fstab = Path("/mnt/etc/fstab")
@@ -33,60 +51,104 @@ def base_install(country: str):
         print(f"Error generating fstab: {e}")
         sys.exit(1)
 
-def chroot_config(username: str, host_name: str, user_pass: str, root_pass: str, timezone: str, gpu: str):
-    chroot_script = f"""
-#!/usr/bin/env bash
+# A deployed image was captured on another machine and carries no /boot: give
+# this host its own identity and its kernel; the initramfs is rebuilt below
+IMAGE_HOST_RESET = """
+rm -f /etc/machine-id /etc/ssh/ssh_host_*
+systemd-machine-id-setup
+for pkgbase in /usr/lib/modules/*/pkgbase; do
+    install -Dm644 "$(dirname "$pkgbase")/vmlinuz" "/boot/vmlinuz-$(cat "$pkgbase")"
+done
+"""
+
+# The busybox initramfs only assembles a multi-device btrfs root with the btrfs hook
+BTRFS_HOOK = """
+sed -i '/^HOOKS=/{/btrfs/!s/ filesystems/ btrfs filesystems/}' /etc/mkinitcpio.conf
+"""
 
+# The busybox initramfs restores a hibernation image with the resume hook, before filesystems
+RESUME_HOOK = """
+sed -i '/^HOOKS=/{/resume/!s/ filesystems/ resume filesystems/}' /etc/mkinitcpio.conf
+"""
+
+# Host-specific packages (microcode, zram-generator) a deployed image may lack;
+# pacstrap installs already have them, so pacman -T finds nothing missing
+EXTRA_PACKAGES = """
+missing=$(pacman -T {packages})
+[ -z "$missing" ] || pacman -Syu --needed --noconfirm $missing
+"""
+
+MAKEPKG_CONF = Path("/mnt/etc/makepkg.conf.d/installer.conf")
+
+def makepkg_config(settings: dict) -> str:
+    """makepkg.conf.d drop-in from a profile's "makepkg" settings.
+
+    makepkg sources it after makepkg.conf, so $(nproc) is evaluated on the machine doing
+    the build and march_native can rewrite the stock CFLAGS instead of replacing them.
+    """
+    lines = []
+    if settings.get("parallel", True):
+        lines += ['MAKEFLAGS="-j$(nproc)"',
+                  "COMPRESSZST=(zstd -c -T0 -)",
+                  "PKGEXT='.pkg.tar.zst'"]
+    if settings.get("march_native"):
+        # Only for machines that build for themselves; images for mixed hardware keep x86-64
+        lines += ['CFLAGS="${CFLAGS/-march=x86-64 -mtune=generic/-march=native}"',
+                  'CXXFLAGS="${CXXFLAGS/-march=x86-64 -mtune=generic/-march=native}"',
+                  'RUSTFLAGS="${RUSTFLAGS} -C target-cpu=native"']
+    if settings.get("tmpfs_builddir"):
+        # /tmp is a tmpfs on Arch; large builds that overflow it can set BUILDDIR back per build
+        lines.append("BUILDDIR=/tmp/makepkg")
+    return "\n".join(lines) + "\n" if lines else ""
+
+LOCALE_SETUP = """
 ln -sf /usr/share/zoneinfo/{timezone} /etc/localtime
 hwclock --systohc
 sed -i 's/^#en_US.UTF-8 UTF-8/en_US.UTF-8 UTF-8/' /etc/locale.gen
 locale-gen
-echo "LANG=en_US.UTF-8" >> /etc/locale.conf
-echo "{host_name}" >> /etc/hostname
-echo root:{root_pass} | chpasswd
+echo "LANG=en_US.UTF-8" > /etc/locale.conf
+echo "{host_name}" > /etc/hostname
 
 cat <<EOF > /etc/hosts
 127.0.0.1 localhost
 ::1       localhost
 127.0.1.1	{host_name}.localdomain	{host_name}
 EOF
+"""
 
-pacman -S mtools cmake docker yt-dlp python3 fastfetch whois zsh git dosfstools man less xclip linux-headers reflector hyprland sddm kitty kate 7zip firefox btop vlc smplayer unrar pipewire pipewire-alsa dolphin pipewire-pulse --noconfirm --needed
-#mesa drivers
-if [ {gpu} -eq 0 ]; then
-    pacman -S libva-mesa-driver vulkan-nouveau xf86-video-nouveau xorg-server xorg-xinit mesa-utils mesa --noconfirm --needed
-#new open kernel Nvidia
-elif [ {gpu} -eq 1 ]; then
-    pacman -S dkms libva-nvidia-driver nvidia-dkms xorg-server xorg-xinit --noconfirm --needed
-#Proprietary Nvidia
-elif [ {gpu} -eq 2 ]; then
-    pacman -S dkms libva-nvidia-driver nvidia-open-dkms xorg-server xorg-xinit --noconfirm --needed
-#intel
-elif [ {gpu} -eq 3 ]; then
-    pacman -S intel-media-driver libva-intel-driver mesa vulkan-intel xorg-server xorg-xinit --noconfirm --needed
-#VirtualBox
-elif [ {gpu} -eq 4 ]; then
-    pacman -S mesa xorg-server xorg-xinit --noconfirm --needed
-else
-    echo "no gpu driver was installed."
-fi
-systemctl enable sddm
-systemctl enable NetworkManager
-systemctl enable snapper-timeline.timer
-systemctl enable snapper-cleanup.timer
-systemctl enable grub-btrfsd.service
-
-useradd -m -G wheel,storage,power,audio,video {username}
+USER_SETUP = """
+id -u {username} >/dev/null 2>&1 || useradd -m -G wheel,storage,power,audio,video {username}
 sed -i 's/^# %wheel ALL=(ALL:ALL) ALL/%wheel ALL=(ALL:ALL) ALL/' /etc/sudoers
-echo {username}:{user_pass} | chpasswd
-
-grub-install --target=x86_64-efi --efi-directory=/boot --bootloader-id=GRUB
-grub-mkconfig -o /boot/grub/grub.cfg
+"""
 
-""".lstrip()
+def chroot_config(username: str, host_name: str, user_pass: str, root_pass: str, timezone: str, services: list[str], from_image: bool = False, multi_device: bool = False, resume_args: str | None = None, extra_packages: list[str] | None = None, makepkg: dict | None = None, bootloader: str = "grub", fast_boot: bool = False, initramfs_compression: str = "zstd", root: str | None = None):
+    cmdline = kernel_cmdline(root, resume_args) if bootloader != "grub" else None
+    initramfs = IMAGE_HOST_RESET if from_image else ""
+    if not fast_boot:
+        initramfs += (BTRFS_HOOK if multi_device else "") + (RESUME_HOOK if resume_args else "")
+    initramfs += initramfs_script(fast_boot, initramfs_compression, bootloader, cmdline)
+    if initramfs:
+        initramfs += "mkinitcpio -P\n"
+    boot_loader = bootloader_script(bootloader, fast_boot, cmdline)
+    if bootloader == "grub":
+        if resume_args:
+            boot_loader += f"sed -i '/^GRUB_CMDLINE_LINUX_DEFAULT=/{{/resume=/!s/\"$/ {resume_args}\"/}}' /etc/default/grub\n"
+        boot_loader += "grub-mkconfig -o /boot/grub/grub.cfg\n"
 
-    chroot_path = Path("/mnt/chroot.sh")
-    write_file(chroot_path, chroot_script, mode=0o755)
+    makepkg_conf = makepkg_config(makepkg or {})
+    if makepkg_conf:
+        write_file(MAKEPKG_CONF, makepkg_conf, mode=0o644)
+    else:
+        # A reprovision to a profile without makepkg tuning must not keep the last one's -march=native
+        MAKEPKG_CONF.unlink(missing_ok=True)
 
-    run_command(["arch-chroot", "/mnt", "sh", "/chroot.sh"])
-    run_command(["rm", "-f", "/mnt/chroot.sh"])
\ No newline at end of file
+    # One chroot for every step; the passwords go to chpasswd over the session's stdin
+    with ChrootSession() as chroot:
+        if extra_packages:
+            chroot.run("packages", EXTRA_PACKAGES.format(packages=" ".join(extra_packages)))
+        chroot.run("initramfs", initramfs)
+        chroot.run("locale", LOCALE_SETUP.format(timezone=timezone, host_name=host_name))
+        chroot.run("services", "\n".join(f"systemctl enable {service}" for service in services))
+        chroot.run("users", USER_SETUP.format(username=username))
+        chroot.run("passwords", "chpasswd", secrets=[f"root:{root_pass}", f"{username}:{user_pass}"])
+        chroot.run("bootloader", boot_loader)
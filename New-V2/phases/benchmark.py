@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+import json
+import shutil
+import subprocess
+import time
+from pathlib import Path
+
+from .library import capture_command
+from .library import run_command
+from .library import write_file
+from .mount_layout import MountLayout
+from .report import REPORT
+
+# Checked with the other host tools before the wipe; installing them mid-install
+# would be a partial upgrade of the live host
+HOST_TOOLS = ["fio", "compsize"]
+# Installed on the target so the first-boot unit can check the GPU driver stack
+GPU_TOOLS = ["vulkan-tools", "libva-utils"]
+FIO_SIZE = "256M"
+FIO_RUNTIME = 10
+# One queue-depth-1 sequential pass and one deep random pass each way;
+# --direct=1 so the page cache does not hide the disk
+FIO_JOBS = [
+    ("seq-write", ["--rw=write", "--bs=1M", "--iodepth=1"]),
+    ("seq-read", ["--rw=read", "--bs=1M", "--iodepth=1"]),
+    ("rand-write", ["--rw=randwrite", "--bs=4k", "--iodepth=32"]),
+    ("rand-read", ["--rw=randread", "--bs=4k", "--iodepth=32"]),
+]
+# Every job's --runtime, plus laying out the test file on a slow disk
+FIO_TIMEOUT = len(FIO_JOBS) * FIO_RUNTIME + 300
+COMPSIZE_TIMEOUT = 600
+PACMAN_QUERIES = {
+    "count": ["-Qq"],
+    "info": ["-Qi"],
+    "search": ["-Ss", "linux"],
+}
+FIRST_BOOT_RESULT = "/var/log/installer/first-boot.json"
+FIRST_BOOT_SCRIPT = "/usr/local/lib/installer/first-boot-benchmark.sh"
+
+# Runs from a timer rather than at boot: a oneshot in the boot transaction would keep
+# the boot from ever finishing and systemd-analyze from reporting it
+FIRST_BOOT_TIMER = """[Unit]
+Description=Record first-boot timing and GPU driver checks for the install report
+
+[Timer]
+OnBootSec=2min
+
+[Install]
+WantedBy=timers.target
+"""
+
+FIRST_BOOT_SERVICE = f"""[Unit]
+Description=Record first-boot timing and GPU driver checks for the install report
+ConditionPathExists=!{FIRST_BOOT_RESULT}
+
+[Service]
+Type=oneshot
+ExecStart={FIRST_BOOT_SCRIPT}
+"""
+
+FIRST_BOOT_BENCHMARK = f"""#!/bin/sh
+# Lines of command output as a JSON string array. vulkaninfo indents with tabs, and JSON
+# allows no raw control characters: tabs become \\t, the rest (ESC, \\r, ...) are dropped
+json_lines() {{
+    tr -d '\\000-\\010\\013-\\037' |
+        sed 's/^[[:space:]]*//; s/\\\\/\\\\\\\\/g; s/"/\\\\"/g; s/\\t/\\\\t/g; s/.*/"&"/' | paste -sd, -
+}}
+
+systemctl is-system-running --wait >/dev/null 2>&1
+analyze=$(systemd-analyze time 2>&1 | head -n 1 | json_lines)
+blame=$(systemd-analyze blame --no-pager 2>&1 | head -n 15 | json_lines)
+vulkan=$(vulkaninfo --summary 2>&1 | grep -E 'deviceName|driverName|driverInfo' | json_lines)
+vaapi=$(vainfo --display drm 2>&1 | grep -E 'Driver version|VAProfile' | head -n 30 | json_lines)
+
+mkdir -p "$(dirname {FIRST_BOOT_RESULT})"
+printf '{{"systemd_analyze": [%s], "blame": [%s], "vulkan": [%s], "vaapi": [%s]}}\\n' \\
+    "$analyze" "$blame" "$vulkan" "$vaapi" > {FIRST_BOOT_RESULT}.tmp
+mv {FIRST_BOOT_RESULT}.tmp {FIRST_BOOT_RESULT}
+systemctl disable installer-boot-benchmark.timer
+"""
+
+
+def _mount_options(target: str) -> str | None:
+    for line in Path("/proc/self/mounts").read_text().splitlines():
+        fields = line.split()
+        if fields[1] == target:
+            return fields[3]
+    return None
+
+
+def _fio(directory: Path) -> dict:
+    command = ["fio", "--output-format=json", f"--directory={directory}", f"--size={FIO_SIZE}",
+               "--direct=1", "--ioengine=libaio", f"--runtime={FIO_RUNTIME}", "--group_reporting"]
+    for name, options in FIO_JOBS:
+        # stonewall: each job starts after the previous one, so they do not share the disk
+        command += [f"--name={name}", *options, "--stonewall"]
+    returncode, output = capture_command(command, timeout=FIO_TIMEOUT)
+    if returncode != 0:
+        # fio's own message is in the event log with the rest of its output
+        return {"error": f"fio exited with code {returncode}"}
+    results = {}
+    for job in json.loads(output).get("jobs", []):
+        side = job["read"] if job["read"]["io_bytes"] else job["write"]
+        p99 = side.get("clat_ns", {}).get("percentile", {}).get("99.000000", 0)
+        results[job["jobname"]] = {
+            "bandwidth_mib_s": round(side["bw"] / 1024, 1),
+            "iops": round(side["iops"]),
+            "p99_latency_ms": round(p99 / 1e6, 3),
+        }
+    return results
+
+
+def benchmark_io(layout: MountLayout) -> dict:
+    """fio on every mounted subvolume, recorded with the mount options that were actually in effect."""
+    results = {}
+    for subvolume in layout.mount_order():
+        directory = Path(subvolume.target) / ".installer-fio"
+        directory.mkdir(exist_ok=True)
+        try:
+            results[subvolume.name] = {"mount_options": _mount_options(subvolume.target), **_fio(directory)}
+        finally:
+            shutil.rmtree(directory, ignore_errors=True)
+    return results
+
+
+def benchmark_compression(layout: MountLayout) -> dict:
+    """Compression ratio per subvolume from compsize; -x stops at the nested subvolumes."""
+    results = {}
+    for subvolume in layout.mount_order():
+        _, output = capture_command(["compsize", "-b", "-x", subvolume.target], timeout=COMPSIZE_TIMEOUT)
+        for line in output.splitlines():
+            fields = line.split()
+            if fields[:1] == ["TOTAL"] and len(fields) >= 4:
+                disk, uncompressed = int(fields[2]), int(fields[3])
+                results[subvolume.name] = {
+                    "disk_bytes": disk,
+                    "uncompressed_bytes": uncompressed,
+                    "ratio": round(uncompressed / disk, 2) if disk else None,
+                }
+    return results
+
+
+def benchmark_pacman_db() -> dict:
+    """Query latency against the target's package databases, first with a cold page cache."""
+    results = {}
+    for name, query in PACMAN_QUERIES.items():
+        command = ["pacman", "--root", "/mnt", "--dbpath", "/mnt/var/lib/pacman", *query]
+        timings = {}
+        for cache in ["cold", "warm"]:
+            if cache == "cold":
+                subprocess.run(["sync"], check=False)
+                Path("/proc/sys/vm/drop_caches").write_text("3\n")
+            start = time.monotonic()
+            subprocess.run(command, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, check=False)
+            timings[f"{cache}_ms"] = round((time.monotonic() - start) * 1000, 1)
+        results[name] = timings
+    return results
+
+
+def install_first_boot_benchmark() -> None:
+    write_file(Path("/mnt" + FIRST_BOOT_SCRIPT), FIRST_BOOT_BENCHMARK, mode=0o755)
+    write_file(Path("/mnt/etc/systemd/system/installer-boot-benchmark.service"), FIRST_BOOT_SERVICE, mode=0o644)
+    write_file(Path("/mnt/etc/systemd/system/installer-boot-benchmark.timer"), FIRST_BOOT_TIMER, mode=0o644)
+    run_command(["systemctl", "--root=/mnt", "enable", "installer-boot-benchmark.timer"])
+
+
+def run_benchmarks(layout: MountLayout) -> None:
+    """Measure the installed system and store the results under "benchmark" in the install report."""
+    install_first_boot_benchmark()
+    results = {
+        "io": benchmark_io(layout),
+        "compression": benchmark_compression(layout),
+        "pacman_db": benchmark_pacman_db(),
+        # Filled in on the first boot, after the install report was written
+        "first_boot": {"result": FIRST_BOOT_RESULT},
+    }
+    with REPORT.lock:
+        REPORT.extra["benchmark"] = results
+    for name, io in results["io"].items():
+        if "error" in io:
+            print(f"{name:<12} fio failed: {io['error']}")
+            continue
+        summary = "  ".join(f"{job} {io[job]['bandwidth_mib_s']} MiB/s" for job, _ in FIO_JOBS if job in io)
+        print(f"{name:<12} {summary}")
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+from .library import command_output
+
+BOOTLOADERS = ["grub", "systemd-boot", "uki"]
+INITRAMFS_COMPRESSION = ["zstd", "lz4"]
+
+# systemd replaces udev/usr/resume and assembles multi-device btrfs through its udev
+# rules, so the busybox btrfs and resume hooks are not needed
+FAST_HOOKS = "HOOKS=(systemd autodetect microcode modconf kms keyboard sd-vconsole block filesystems fsck)"
+
+# Only the autodetected image is built; the fallback doubles mkinitcpio time and /boot usage
+NO_FALLBACK = """
+sed -i "s/^PRESETS=.*/PRESETS=('default')/" /etc/mkinitcpio.d/*.preset
+rm -f /boot/initramfs-*-fallback.img
+"""
+
+# mkinitcpio writes one UKI per kernel into the ESP, where systemd-boot finds it without entries
+UKI_PRESETS = """
+for preset in /etc/mkinitcpio.d/*.preset; do
+    kernel=$(basename "$preset" .preset)
+    sed -i -e "s|^#\\?default_uki=.*|default_uki=\\"/boot/EFI/Linux/arch-$kernel.efi\\"|" \\
+        -e 's|^default_image=|#default_image=|' "$preset"
+done
+mkdir -p /boot/EFI/Linux
+rm -f /boot/initramfs-*.img
+"""
+
+SYSTEMD_BOOT_LOADER = """
+bootctl install --esp-path=/boot
+cat <<LOADER > /boot/loader/loader.conf
+timeout 1
+editor no
+LOADER
+systemctl enable systemd-boot-update.service
+"""
+
+SYSTEMD_BOOT_ENTRIES = """
+for preset in /etc/mkinitcpio.d/*.preset; do
+    kernel=$(basename "$preset" .preset)
+    cat <<ENTRY > "/boot/loader/entries/arch-$kernel.conf"
+title   Arch Linux ($kernel)
+linux   /vmlinuz-$kernel
+initrd  /initramfs-$kernel.img
+options CMDLINE
+ENTRY
+done
+"""
+
+# Services that only make sense with GRUB, such as grub-btrfsd regenerating grub.cfg
+GRUB_SERVICES = {"grub-btrfsd.service"}
+
+GRUB_LOADER = """
+grub-install --target=x86_64-efi --efi-directory=/boot --bootloader-id=GRUB
+"""
+
+
+def boot_services(services: list[str], bootloader: str) -> list[str]:
+    return services if bootloader == "grub" else [s for s in services if s not in GRUB_SERVICES]
+
+
+def kernel_cmdline(root: str, extra: str | None = None) -> str:
+    """Command line for systemd-boot entries and UKIs, which have no grub-mkconfig to probe root."""
+    uuid = command_output(["blkid", "-s", "UUID", "-o", "value", root])
+    return " ".join(filter(None, [f"root=UUID={uuid}", "rootflags=subvol=@", "rw", extra]))
+
+
+def initramfs_script(fast: bool, compression: str, bootloader: str, cmdline: str | None) -> str:
+    """mkinitcpio.conf and preset edits; the caller runs mkinitcpio -P once afterwards."""
+    script = ""
+    if fast:
+        script += f"""
+sed -i 's/^HOOKS=.*/{FAST_HOOKS}/' /etc/mkinitcpio.conf
+sed -i 's/^#\\?COMPRESSION="{compression}"/COMPRESSION="{compression}"/' /etc/mkinitcpio.conf
+[ -f /etc/vconsole.conf ] || echo "KEYMAP=us" > /etc/vconsole.conf
+""" + NO_FALLBACK
+    if bootloader == "uki":
+        script += f'echo "{cmdline}" > /etc/kernel/cmdline\n' + UKI_PRESETS
+    return script
+
+
+def bootloader_script(bootloader: str, fast: bool, cmdline: str | None) -> str:
+    """Install the boot loader; grub-mkconfig still follows for grub."""
+    if bootloader == "grub":
+        timeout = "sed -i 's/^GRUB_TIMEOUT=.*/GRUB_TIMEOUT=1/' /etc/default/grub\n" if fast else ""
+        return GRUB_LOADER + timeout
+    if bootloader == "systemd-boot":
+        return SYSTEMD_BOOT_LOADER + SYSTEMD_BOOT_ENTRIES.replace("CMDLINE", cmdline or "")
+    return SYSTEMD_BOOT_LOADER
@@ -25,19 +25,21 @@ def require_root():
         print("This script must be run as root. Try: sudo python3 main.py")
         sys.exit(1)
 
-def ensure_dependencies() -> None:
-    for dependency in [
+def ensure_dependencies(extra: list[str] | None = None) -> None:
+    for dependency in (extra or []) + [
         "reflector",
         "pacman",
         "pacman-key",
         "lsblk",
         "fdisk",
+        "sfdisk",
         "mkfs.fat",
         "mkswap",
         "swapon",
         "mkfs.btrfs",
         "mount",
         "btrfs",
+        "chattr",
         "umount",
         "mkdir",
         "pacstrap",
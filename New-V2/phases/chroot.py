@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+import os
+import subprocess
+import sys
+import threading
+
+from .events import EVENTS
+from .events import emit_line
+from .library import TIMEOUT_EXIT_CODE
+from .library import reap_process
+from .library import register_process
+from .library import stop_process
+from .report import track_command
+
+# Printed by the session after every step, followed by the step's exit code
+STEP_DONE = "__installer_step_done__"
+# Bounds a hung step (a pacman lock, a mkinitcpio hook waiting on input, ...), not a slow one
+STEP_TIMEOUT = 60 * 60
+# For arch-chroot to tear its mounts down after the final exit
+CLOSE_TIMEOUT = 30
+
+
+class ChrootSession:
+    """One arch-chroot into the target for all configuration steps.
+
+    arch-chroot sets up its mounts once and a bash inside it runs each step in a
+    subshell, so steps pay a fork instead of a new chroot. Every step is timed
+    like a command in the install report, and the session's own record carries the
+    CPU time, peak RSS and block I/O of all of them. Secrets travel on the session's
+    stdin pipe only: bash reads a script from a pipe one byte at a time, so a step's
+    `read` gets the lines written right after it and nothing reaches the disk,
+    a process' arguments or the event log.
+    """
+
+    def __init__(self, root: str = "/mnt"):
+        self.root = root
+        self.process: subprocess.Popen | None = None
+        self.group = False
+        self.timed_out = False
+        self.session = None
+        self.record = None
+
+    def __enter__(self) -> "ChrootSession":
+        command = ["arch-chroot", self.root, "bash", "--noprofile", "--norc"]
+        # Its own process group under the event stream, like the runner's commands,
+        # so a cancel or a timeout reaches the step's children too
+        self.group = EVENTS.running
+        self.process = subprocess.Popen(command, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
+                                        stderr=subprocess.STDOUT, text=True, bufsize=1,
+                                        process_group=0 if self.group else None)
+        register_process(self.process.pid, self.group)
+        self.session = track_command(command)
+        self.record = self.session.__enter__()
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    def close(self) -> None:
+        if self.process is None:
+            return
+        try:
+            self.process.stdin.write("exit 0\n")
+            self.process.stdin.close()
+        except OSError:
+            pass
+        watchdog = threading.Timer(CLOSE_TIMEOUT, stop_process, (self.process.pid, self.group))
+        watchdog.daemon = True
+        watchdog.start()
+        try:
+            self.record.exit_code = reap_process(self.process.pid, self.record)
+        finally:
+            watchdog.cancel()
+        self.process.stdout.close()
+        self.session.__exit__(None, None, None)
+        self.process = None
+
+    def run(self, name: str, script: str, secrets: list[str] | None = None, timeout: float | None = STEP_TIMEOUT) -> None:
+        """Run a shell step with `set -e` and exit on failure.
+
+        Args:
+            name: Step name shown in the report, e.g. "locale".
+            script: Shell code run inside the chroot.
+            secrets: Lines passed to the step's stdin, e.g. "user:password" for chpasswd.
+            timeout: Seconds before the session is stopped and the step counts as failed.
+        """
+        if not script.strip():
+            return
+        body = f"( set -e\n{script.strip()}\n)"
+        if secrets:
+            reads = "; ".join(f"IFS= read -r __line{i}" for i in range(len(secrets)))
+            lines = " ".join(f'"$__line{i}"' for i in range(len(secrets)))
+            command = f"{{ {reads}; printf '%s\\n' {lines}; }} | {body}\n" + "".join(s + "\n" for s in secrets)
+        else:
+            command = f"{body} </dev/null\n"
+        # The session cannot skip a step it is stuck in, so a timeout ends it, and the install
+        watchdog = threading.Timer(timeout, self._time_out, (name, timeout)) if timeout is not None else None
+        with track_command(["arch-chroot", name]) as record:
+            self.process.stdin.write(command + f'echo "{STEP_DONE} $?"\n')
+            self.process.stdin.flush()
+            if watchdog is not None:
+                watchdog.daemon = True
+                watchdog.start()
+            try:
+                # The reads run in the pipeline's own subshell, so the session never keeps the secrets
+                record.exit_code = self._wait_step(name)
+            finally:
+                if watchdog is not None:
+                    watchdog.cancel()
+            record.timed_out = record.exit_code == TIMEOUT_EXIT_CODE
+        if record.exit_code != 0:
+            print(f"Chroot step failed: {name}\nExit code: {record.exit_code}")
+            sys.exit(record.exit_code)
+
+    def _wait_step(self, name: str) -> int:
+        tail: list[str] = []
+        for line in iter(self.process.stdout.readline, ""):
+            if line.startswith(STEP_DONE):
+                code = int(line.split()[1])
+                if code != 0 and EVENTS.quiet:
+                    print("\n".join(tail))
+                return code
+            if EVENTS.running:
+                emit_line(f"chroot:{name}", line, False, tail)
+            else:
+                print(line, end="", flush=True)
+        # bash or arch-chroot itself went away mid-step: timed out, cancelled or crashed
+        if self.timed_out:
+            return TIMEOUT_EXIT_CODE
+        # WNOWAIT leaves the reaping, and the session's accounting, to close()
+        return os.waitid(os.P_PID, self.process.pid, os.WEXITED | os.WNOWAIT).si_status or 1
+
+    def _time_out(self, name: str, timeout: float) -> None:
+        self.timed_out = True
+        print(f"Chroot step timed out after {timeout:g}s: {name}")
+        stop_process(self.process.pid, self.group)
@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+import json
+import re
+import sys
+import urllib.error
+import urllib.request
+from dataclasses import dataclass
+from pathlib import Path
+
+from .fdisk_setup import valid_disk_name
+from .user_inputs import ask
+
+PLACEHOLDER_PASSWORD = "CHANGE_ME"
+# Top-level keys that are shorthands for the matching command line options
+OPTION_SHORTHANDS = ["profile", "layout"]
+INPUT_KEYS = ["country", "username", "hostname", "user_pass", "root_pass", "timezone", "gpu"]
+KNOWN_KEYS = {"disks", "wipe", "reboot", "options", *OPTION_SHORTHANDS, *INPUT_KEYS}
+
+
+@dataclass
+class InstallConfig:
+    disks: list[str]
+    country: str
+    username: str
+    hostname: str
+    user_pass: str
+    root_pass: str
+    timezone: str
+    gpu: str | None
+    reboot: bool
+
+
+def load_config(source: str) -> dict:
+    """Read the install config from a path, an http(s) URL (e.g. served next to a PXE image) or - for stdin."""
+    try:
+        if source == "-":
+            # Piped in by a wrapper, so the passwords never touch the disk
+            text = sys.stdin.read()
+        elif re.match(r"https?://", source):
+            with urllib.request.urlopen(source, timeout=30) as response:
+                text = response.read().decode()
+        else:
+            text = Path(source).read_text()
+        config = json.loads(text)
+    except (OSError, urllib.error.URLError, UnicodeDecodeError, json.JSONDecodeError) as e:
+        print(f"Error reading install config {source}: {e}")
+        sys.exit(1)
+    check_config_keys(config, source)
+    return config
+
+
+def check_config_keys(config, source: str) -> None:
+    if not isinstance(config, dict):
+        print(f"Error: install config {source} must be a JSON object.")
+        sys.exit(1)
+    unknown = sorted(set(config) - KNOWN_KEYS)
+    if unknown:
+        print(f"Error: unknown key(s) in install config {source}: {', '.join(unknown)}")
+        sys.exit(1)
+
+
+def config_argv(config: dict) -> list[str]:
+    """Turn "options" (and the profile/layout shorthands) into command line arguments.
+
+    They are parsed before the real command line, so argparse validates them and
+    options given on the command line still win.
+    """
+    options = dict(config.get("options", {}))
+    options.update({key: config[key] for key in OPTION_SHORTHANDS if key in config})
+    argv = []
+    for key, value in options.items():
+        flag = "--" + key.replace("_", "-")
+        if value is True:
+            argv.append(flag)
+        elif value not in (False, None):
+            argv += [flag, str(value)]
+    return argv
+
+
+def _check_field(field: str, value) -> str | None:
+    """Return an error message for an invalid input value, None when it is usable."""
+    if not isinstance(value, str) or not value.strip():
+        return "missing"
+    if field in {"user_pass", "root_pass"}:
+        if value == PLACEHOLDER_PASSWORD:
+            return f"still set to {PLACEHOLDER_PASSWORD}"
+        if "\n" in value:
+            return "contains a newline"
+    elif field == "username" and not re.fullmatch(r"[a-z_][a-z0-9_-]{0,31}", value):
+        return "not a valid login name"
+    elif field == "hostname" and not re.fullmatch(r"[A-Za-z0-9][A-Za-z0-9-]{0,62}", value):
+        return "not a valid hostname"
+    elif field == "timezone" and (".." in value or not (Path("/usr/share/zoneinfo") / value).is_file()):
+        return "not found in /usr/share/zoneinfo"
+    return None
+
+
+def validate_config(config: dict, gpu_choices: list[str], require_wipe: bool = True) -> InstallConfig:
+    """Check every value before any disk is touched.
+
+    Invalid or missing inputs are prompted for when a TTY is attached; otherwise all
+    problems are reported at once and the install stops.
+
+    Args:
+        config: Parsed install config.
+        gpu_choices: Accepted GPU overrides, see packages.gpu_options.
+        require_wipe: False for --reprovision, which keeps the disks' contents.
+    """
+    errors = []
+    interactive = sys.stdin.isatty()
+
+    disks = config.get("disks")
+    if isinstance(disks, str):
+        disks = disks.split()
+    if not disks or not isinstance(disks, list) or len(set(disks)) != len(disks):
+        errors.append("disks: give one or more distinct drive names, e.g. [\"nvme0n1\"]")
+    else:
+        for disk in disks:
+            if not valid_disk_name(disk) or not Path(f"/sys/block/{disk}").is_dir():
+                errors.append(f"disks: {disk} is not an sdX or nvmeXnY drive on this machine")
+    if require_wipe and config.get("wipe") is not True:
+        errors.append("wipe: must be true to let an unattended install erase the listed disks")
+
+    values = {}
+    for field in INPUT_KEYS:
+        if field == "gpu":
+            continue
+        value = config.get(field)
+        problem = _check_field(field, value)
+        while problem is not None and interactive:
+            print(f"Install config: {field} is {problem}.")
+            value = ask(field)
+            problem = _check_field(field, value)
+        if problem is not None:
+            errors.append(f"{field}: {problem}")
+        values[field] = value
+
+    gpu = config.get("gpu")
+    if gpu is not None:
+        gpu = str(gpu)
+    if gpu is not None and gpu not in gpu_choices:
+        if interactive:
+            gpu = ask("gpu")
+        else:
+            errors.append(f"gpu: {gpu} is not one of {', '.join(gpu_choices)} (null keeps the profile's choice)")
+
+    if errors:
+        print("Error: the install config is not valid:")
+        for error in errors:
+            print(f"  {error}")
+        sys.exit(1)
+    return InstallConfig(disks=disks, gpu=gpu, reboot=config.get("reboot") is True, **values)
@@ -0,0 +1,259 @@
+#!/usr/bin/env python3
+import math
+import re
+import sys
+from dataclasses import dataclass
+from dataclasses import field
+from pathlib import Path
+
+from .library import run_command
+
+MIB = 1024 * 1024
+GIB = 1024 * MIB
+SECTOR = 512  # sysfs always reports sizes in 512-byte units
+MIN_ROOT_BYTES = 8 * GIB
+# Some USB bridges report nonsense optimal_io_size values; ignore anything above this
+MAX_ALIGNMENT_BYTES = 16 * MIB
+
+# Fewest devices each btrfs block group profile works with
+PROFILE_MIN_DEVICES = {
+    "single": 1,
+    "dup": 1,
+    "raid0": 2,
+    "raid1": 2,
+    "raid1c3": 3,
+    "raid1c4": 4,
+    "raid10": 4,
+}
+
+PARTITION_TYPES = {
+    "efi": "U",
+    "swap": "S",
+    "root": "L",
+}
+
+
+@dataclass
+class DiskInfo:
+    name: str
+    size_bytes: int
+    rotational: bool
+    logical_block_size: int
+    physical_block_size: int
+    optimal_io_size: int
+    # USB bridges and card readers: usually far slower at small random writes than their sequential rate
+    removable: bool = False
+    # The device accepts TRIM/UNMAP (queue/discard_max_bytes is non-zero)
+    discard: bool = False
+
+    @property
+    def path(self) -> str:
+        return f"/dev/{self.name}"
+
+
+@dataclass
+class Partition:
+    number: int
+    role: str
+    start: int  # bytes
+    size: int | None  # bytes, None takes the rest of the disk
+
+
+@dataclass
+class LayoutPlan:
+    disk: DiskInfo
+    ram_bytes: int
+    alignment_bytes: int
+    hibernate: bool
+    partitions: list[Partition] = field(default_factory=list)
+    # Extra disks that only carry a btrfs partition joined to the root filesystem
+    members: list["LayoutPlan"] = field(default_factory=list)
+    data_profile: str | None = None
+    metadata_profile: str | None = None
+
+    def all_disks(self) -> list["LayoutPlan"]:
+        return [self] + self.members
+
+    def root_devices(self) -> list[str]:
+        return [plan.partition_path("root") for plan in self.all_disks()]
+
+    def partition(self, role: str) -> Partition | None:
+        return next((p for p in self.partitions if p.role == role), None)
+
+    def partition_path(self, role: str) -> str | None:
+        partition = self.partition(role)
+        return None if partition is None else partition_path(self.disk.name, partition.number)
+
+    def sfdisk_script(self) -> str:
+        # sfdisk counts in logical sectors, which are 4 KiB on 4Kn drives
+        sector = self.disk.logical_block_size
+        lines = ["label: gpt"]
+        for p in self.partitions:
+            size = f", size={p.size // sector}" if p.size is not None else ""
+            lines.append(f"start={p.start // sector}{size}, type={PARTITION_TYPES[p.role]}")
+        return "\n".join(lines) + "\n"
+
+    def describe(self) -> str:
+        disk = self.disk
+        kind = "rotational" if disk.rotational else "solid-state"
+        lines = [
+            f"Layout plan for {disk.path}: {disk.size_bytes / GIB:.1f} GiB {kind}, "
+            f"{disk.logical_block_size}/{disk.physical_block_size}-byte sectors, "
+            f"optimal I/O {disk.optimal_io_size or 'unreported'}",
+            f"RAM {self.ram_bytes / GIB:.1f} GiB, hibernation {'on' if self.hibernate else 'off'}, "
+            f"partitions aligned to {self.alignment_bytes // 1024} KiB",
+        ]
+        for p in self.partitions:
+            if p.size is None:
+                size = f"{(disk.size_bytes - p.start) / GIB:.1f} GiB (rest)"
+            elif p.size >= GIB:
+                size = f"{p.size / GIB:.1f} GiB"
+            else:
+                size = f"{p.size // MIB} MiB"
+            lines.append(f"  {partition_path(disk.name, p.number):<18} {p.role:<5} {size}")
+        for member in self.members:
+            rest = (member.disk.size_bytes - member.partitions[0].start) / GIB
+            kind = "rotational" if member.disk.rotational else "solid-state"
+            lines.append(f"  {member.partition_path('root'):<18} root  {rest:.1f} GiB (whole {kind} disk)")
+        if self.members:
+            lines.append(f"btrfs across {len(self.all_disks())} devices: data {self.data_profile}, "
+                         f"metadata {self.metadata_profile}")
+        return "\n".join(lines)
+
+
+def partition_path(name: str, number: int) -> str:
+    # nvme0n1 -> nvme0n1p1, sda -> sda1
+    suffix = "p" if re.search(r"\d$", name) else ""
+    return f"/dev/{name}{suffix}{number}"
+
+
+def _read_int(path: Path, default: int = 0) -> int:
+    try:
+        return int(path.read_text().strip())
+    except (OSError, ValueError):
+        return default
+
+
+def probe_disk(name: str) -> DiskInfo:
+    queue = Path(f"/sys/block/{name}/queue")
+    size_sectors = _read_int(Path(f"/sys/block/{name}/size"))
+    if size_sectors == 0:
+        print(f"Error: cannot read the size of /dev/{name} from sysfs.")
+        sys.exit(1)
+    return DiskInfo(
+        name=name,
+        size_bytes=size_sectors * SECTOR,
+        rotational=_read_int(queue / "rotational", 1) == 1,
+        logical_block_size=_read_int(queue / "logical_block_size", SECTOR),
+        physical_block_size=_read_int(queue / "physical_block_size", SECTOR),
+        optimal_io_size=_read_int(queue / "optimal_io_size"),
+        # Many USB SSDs report removable=0, so also look at the bus the device hangs off
+        removable=_read_int(Path(f"/sys/block/{name}/removable")) == 1
+        or "/usb" in str(Path(f"/sys/block/{name}").resolve()),
+        discard=_read_int(queue / "discard_max_bytes") > 0,
+    )
+
+
+def ram_bytes() -> int:
+    for line in Path("/proc/meminfo").read_text().splitlines():
+        if line.startswith("MemTotal:"):
+            return int(line.split()[1]) * 1024
+    return 0
+
+
+def alignment_bytes(disk: DiskInfo) -> int:
+    """1 MiB, or a multiple of it that is also a multiple of the device's optimal I/O size."""
+    alignment = MIB
+    for size in (disk.physical_block_size, disk.optimal_io_size):
+        if size > 0:
+            candidate = math.lcm(alignment, size)
+            if candidate <= MAX_ALIGNMENT_BYTES:
+                alignment = candidate
+    return alignment
+
+
+def swap_size_bytes(ram: int, hibernate: bool) -> int:
+    """Size swap from RAM: hibernation needs room for a full image, otherwise keep it modest."""
+    ram_gib = ram / GIB
+    if hibernate:
+        return int((ram_gib + math.ceil(math.sqrt(ram_gib))) * GIB)
+    if ram_gib <= 2:
+        return int(2 * ram)
+    if ram_gib <= 8:
+        return ram
+    return int(min(max(4, math.sqrt(ram_gib)), 8) * GIB)
+
+
+def _align_up(value: int, alignment: int) -> int:
+    return -(-value // alignment) * alignment
+
+
+def plan_layout(
+    disk: DiskInfo,
+    ram: int,
+    hibernate: bool = False,
+    efi_mib: int = 256,
+    swap_gib: float | None = None,
+    members: list[DiskInfo] | None = None,
+    data_profile: str | None = None,
+    metadata_profile: str | None = None,
+) -> LayoutPlan:
+    """Build an aligned EFI + swap + btrfs root plan for one disk, optionally spanning more disks.
+
+    Args:
+        disk: Probed target disk; it carries EFI, swap and the first btrfs device.
+        ram: Installed memory in bytes.
+        hibernate: Size swap to hold a hibernation image.
+        efi_mib: EFI system partition size.
+        swap_gib: Explicit swap size instead of the RAM-based default.
+        members: Additional disks, each turned into one btrfs partition of the same filesystem.
+        data_profile: btrfs data profile (mkfs.btrfs -d); defaults to raid0 with members.
+        metadata_profile: btrfs metadata profile (mkfs.btrfs -m); defaults to raid1 with members.
+    """
+    align = alignment_bytes(disk)
+    plan = LayoutPlan(disk=disk, ram_bytes=ram, alignment_bytes=align, hibernate=hibernate)
+    swap = int(swap_gib * GIB) if swap_gib is not None else swap_size_bytes(ram, hibernate)
+
+    offset = align
+    for role, size in [("efi", efi_mib * MIB), ("swap", swap)]:
+        if size <= 0:
+            continue
+        size = _align_up(size, align)
+        plan.partitions.append(Partition(len(plan.partitions) + 1, role, offset, size))
+        offset += size
+    plan.partitions.append(Partition(len(plan.partitions) + 1, "root", offset, None))
+
+    root_bytes = disk.size_bytes - offset - MIB  # leave room for the backup GPT
+    if root_bytes < MIN_ROOT_BYTES:
+        print(f"Error: {disk.path} is too small: {root_bytes / GIB:.1f} GiB left for root, "
+              f"at least {MIN_ROOT_BYTES // GIB} GiB needed.")
+        sys.exit(1)
+
+    for member in members or []:
+        member_align = alignment_bytes(member)
+        plan.members.append(LayoutPlan(disk=member, ram_bytes=ram, alignment_bytes=member_align, hibernate=False,
+                                       partitions=[Partition(1, "root", member_align, None)]))
+    if plan.members:
+        data_profile = data_profile or "raid0"
+        metadata_profile = metadata_profile or "raid1"
+    device_count = len(plan.all_disks())
+    for kind, profile in [("data", data_profile), ("metadata", metadata_profile)]:
+        if profile is None:
+            continue
+        if profile not in PROFILE_MIN_DEVICES:
+            print(f"Error: unknown btrfs {kind} profile '{profile}'.")
+            sys.exit(1)
+        if PROFILE_MIN_DEVICES[profile] > device_count:
+            print(f"Error: btrfs {kind} profile {profile} needs at least "
+                  f"{PROFILE_MIN_DEVICES[profile]} devices, {device_count} given.")
+            sys.exit(1)
+    plan.data_profile = data_profile
+    plan.metadata_profile = metadata_profile
+    return plan
+
+
+def apply_layout(plan: LayoutPlan) -> None:
+    for disk_plan in plan.all_disks():
+        print(f"\nPartitioning {disk_plan.disk.path}...")
+        run_command(["sfdisk", "--wipe", "always", "--wipe-partitions", "always", disk_plan.disk.path],
+                    input_text=disk_plan.sfdisk_script())
@@ -0,0 +1,251 @@
+#!/usr/bin/env python3
+import codecs
+import json
+import queue
+import re
+import shutil
+import socket
+import threading
+import time
+import urllib.error
+import urllib.request
+from pathlib import Path
+from typing import Callable
+
+from .report import REPORT
+from .report import add_listener
+from .report import current_phase
+
+DEFAULT_LOG_PATH = Path("/root/install-events.jsonl")
+TARGET_LOG_PATH = Path("/mnt/var/log/installer/events.jsonl")
+QUEUE_SIZE = 10000
+# A progress line (ending in \r) of one command reaches the console at most this often
+PROGRESS_INTERVAL = 2.0
+HTTP_BATCH_SIZE = 200
+HTTP_BATCH_SECONDS = 1.0
+
+# pacman without a TTY prints one line per package instead of progress bars
+_DOWNLOAD_STARTED = re.compile(r"^\s*(?P<package>\S+) downloading\.\.\.$")
+_DOWNLOAD_PROGRESS = re.compile(
+    r"^\s*(?P<package>\S+)\s+(?P<size>[\d.]+\s+\S*B)\s+(?P<rate>[\d.]+\s+\S*B/s)\s+\S+\s+\[[^\]]*\]\s+(?P<percent>\d+)%")
+_ANSI = re.compile(r"\x1b\[[0-9;?]*[A-Za-z]")
+
+
+class _FileSink:
+    def __init__(self, path: Path):
+        path.parent.mkdir(parents=True, exist_ok=True)
+        self.path = path
+        self.file = path.open("a", buffering=1)
+
+    def __call__(self, event: dict) -> None:
+        self.file.write(json.dumps(event) + "\n")
+
+    def close(self) -> None:
+        self.file.close()
+
+
+class _TcpSink:
+    """JSON lines to host:port, e.g. a log collector; reconnects at most every few seconds."""
+
+    def __init__(self, host: str, port: int):
+        self.address = (host, port)
+        self.sock: socket.socket | None = None
+        self.next_attempt = 0.0
+
+    def __call__(self, event: dict) -> None:
+        if self.sock is None:
+            if time.monotonic() < self.next_attempt:
+                return
+            try:
+                self.sock = socket.create_connection(self.address, timeout=2)
+            except OSError:
+                self.next_attempt = time.monotonic() + 5
+                return
+        try:
+            self.sock.sendall((json.dumps(event) + "\n").encode())
+        except OSError:
+            self.sock.close()
+            self.sock = None
+
+    def close(self) -> None:
+        if self.sock is not None:
+            self.sock.close()
+
+
+class _HttpSink:
+    """POSTs JSON arrays of events; a failed batch is dropped rather than held back."""
+
+    def __init__(self, url: str):
+        self.url = url
+        self.batch: list[dict] = []
+        self.last_flush = time.monotonic()
+
+    def __call__(self, event: dict) -> None:
+        self.batch.append(event)
+        if len(self.batch) >= HTTP_BATCH_SIZE or time.monotonic() - self.last_flush >= HTTP_BATCH_SECONDS:
+            self.flush()
+
+    def flush(self) -> None:
+        batch, self.batch, self.last_flush = self.batch, [], time.monotonic()
+        if not batch:
+            return
+        request = urllib.request.Request(self.url, data=json.dumps(batch).encode(),
+                                         headers={"Content-Type": "application/json"})
+        try:
+            urllib.request.urlopen(request, timeout=5).close()
+        except (urllib.error.URLError, OSError):
+            pass
+
+    def close(self) -> None:
+        self.flush()
+
+
+class _ConsoleSink:
+    """Command output on the terminal; progress redraws are thinned out so a serial console keeps up."""
+
+    def __init__(self, quiet: bool):
+        self.quiet = quiet
+        self.last_progress: dict[str, float] = {}
+
+    def __call__(self, event: dict) -> None:
+        if event["event"] != "output" or self.quiet:
+            return
+        prefix = f"[{event['phase']}] " if event.get("phase") else ""
+        if event.get("progress"):
+            now = time.monotonic()
+            key = event.get("phase") or event["command"]
+            if now - self.last_progress.get(key, 0) < PROGRESS_INTERVAL:
+                return
+            self.last_progress[key] = now
+        print(f"{prefix}{event['line']}", flush=True)
+
+
+class EventStream:
+    """Structured install events fanned out to sinks by one background thread.
+
+    emit() never blocks on a sink: output lines are dropped (and counted) when the
+    queue is full, while phase and command events wait up to a second for room.
+    """
+
+    def __init__(self):
+        self.queue: queue.Queue = queue.Queue(QUEUE_SIZE)
+        self.sinks: list[Callable[[dict], None]] = []
+        self.dropped = 0
+        self.thread: threading.Thread | None = None
+        self.log_path: Path | None = None
+        self.quiet = False
+
+    @property
+    def running(self) -> bool:
+        return self.thread is not None
+
+    def add_sink(self, sink: Callable[[dict], None]) -> None:
+        self.sinks.append(sink)
+
+    def start(self, log_path: Path, stream: str | None = None, quiet: bool = False) -> None:
+        self.log_path = log_path
+        self.quiet = quiet
+        self.add_sink(_ConsoleSink(quiet))
+        self.add_sink(_FileSink(log_path))
+        if stream is not None:
+            if stream.startswith("tcp://"):
+                host, _, port = stream[len("tcp://"):].rpartition(":")
+                self.add_sink(_TcpSink(host, int(port)))
+            else:
+                self.add_sink(_HttpSink(stream))
+        add_listener(self.emit)
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def emit(self, event: dict) -> None:
+        if self.thread is None:
+            return
+        event = {"t": round(REPORT.elapsed(), 3), **event}
+        try:
+            if event["event"] in {"output", "download"}:
+                self.queue.put_nowait(event)
+            else:
+                self.queue.put(event, timeout=1)
+        except queue.Full:
+            self.dropped += 1
+
+    def _run(self) -> None:
+        while True:
+            event = self.queue.get()
+            if event is None:
+                return
+            for sink in self.sinks:
+                try:
+                    sink(event)
+                except Exception:
+                    pass
+
+    def close(self) -> None:
+        """Drain the queue, flush the sinks and copy the log next to the target's install report."""
+        if self.thread is None:
+            return
+        self.queue.put(None)
+        self.thread.join(timeout=10)
+        self.thread = None
+        for sink in self.sinks:
+            close = getattr(sink, "close", None)
+            if close is not None:
+                close()
+        if self.dropped:
+            print(f"Warning: {self.dropped} output line(s) were dropped from the event log")
+        if self.log_path is not None and TARGET_LOG_PATH.parent.parent.is_dir():
+            try:
+                TARGET_LOG_PATH.parent.mkdir(parents=True, exist_ok=True)
+                shutil.copyfile(self.log_path, TARGET_LOG_PATH)
+            except OSError as e:
+                print(f"Warning: could not copy the event log to {TARGET_LOG_PATH}: {e}")
+
+
+EVENTS = EventStream()
+
+
+def emit_line(command: str, text: str, progress: bool, tail: list[str]) -> None:
+    line = _ANSI.sub("", text).rstrip()
+    if not line:
+        return
+    phase = current_phase()
+    EVENTS.emit({"event": "output", "phase": phase, "command": command, "line": line, "progress": progress})
+    if not progress:
+        tail.append(line)
+        del tail[:-20]
+    match = _DOWNLOAD_STARTED.match(line)
+    if match:
+        EVENTS.emit({"event": "download", "phase": phase, "package": match["package"], "percent": 0})
+    match = _DOWNLOAD_PROGRESS.match(line)
+    if match and match["percent"] == "100":
+        EVENTS.emit({"event": "download", "phase": phase, "package": match["package"], "percent": 100,
+                     "size": match["size"], "rate": match["rate"]})
+
+
+class OutputLines:
+    """Turn a child's combined stdout/stderr, fed in chunks, into output events.
+
+    Lines ending in a bare carriage return are progress redraws from pacman, curl and the like.
+    """
+
+    def __init__(self, command: str) -> None:
+        self.command = command
+        # The last lines that were not progress redraws, for a failure message
+        self.tail: list[str] = []
+        self.pending = ""
+        # Incremental, so a UTF-8 character split across two reads is not mangled
+        self.decoder = codecs.getincrementaldecoder("utf-8")(errors="replace")
+
+    def feed(self, chunk: bytes) -> None:
+        data = self.pending + self.decoder.decode(chunk)
+        # A final \r may be the first half of a \r\n split across reads; the next chunk tells
+        held = "\r" if data.endswith("\r") else ""
+        parts = re.split(r"(\r\n|\n|\r)", data[:len(data) - len(held)])
+        self.pending = parts.pop() + held
+        for text, separator in zip(parts[::2], parts[1::2]):
+            emit_line(self.command, text, separator == "\r", self.tail)
+
+    def close(self) -> list[str]:
+        emit_line(self.command, self.pending + self.decoder.decode(b"", final=True), False, self.tail)
+        self.pending = ""
+        return self.tail
@@ -2,90 +2,143 @@
 import subprocess
 import sys
 import re
+from pathlib import Path
 
 from .library import confirm
 from .library import run_command
+from .library import try_command
+from .disk_layout import DiskInfo
+from .disk_layout import LayoutPlan
+from .disk_layout import apply_layout
+from .mount_layout import MountLayout
 
-FDISK_TEMPLATE = """
-g
-n
-1
-
-+256M
-n
-2
-
-+4G
-n
-3
-
-
-t
-1
-1
-t
-2
-19
-t
-3
-20
-p
-w
-""".lstrip()
+# Some USB bridges and SMR drives take minutes to trim a whole device
+DISCARD_TIMEOUT = 30 * 60
 
 def list_disks():
     print("Available disks:")
     subprocess.run(["lsblk", "-o", "NAME,SIZE,TYPE,MOUNTPOINT"], check=False)
 
 
-def run_fdisk():
+def valid_disk_name(name: str) -> bool:
+    return re.fullmatch(r"sd[a-z]", name) is not None or re.fullmatch(r"nvme\d+n\d+", name) is not None
 
+
+def select_disks() -> list[str]:
+    """Ask for the target drive(s) and return their names, e.g. ["nvme0n1", "nvme1n1"].
+
+    The first drive gets EFI, swap and root; further drives join the btrfs root filesystem.
+    """
     while True:
-        name = input("Enter the installation drive (e.g., sda or nvme0n1): ").strip().lower()
-        if re.fullmatch(r"sd[a-z]", name) or re.fullmatch(r"nvme\d+n\d+", name):
+        names = input("Enter the installation drive(s), space separated (e.g., sda or nvme0n1 nvme1n1): ").lower().split()
+        if names and all(valid_disk_name(name) for name in names) and len(set(names)) == len(names):
             break
         else:
             print("The drive name was incorrect, try again.")
-    disk_path = f"/dev/{name}"
 
-    print(f"\nCurrent partition table for {disk_path}:")
-    subprocess.run(["fdisk", "-l", disk_path], check=False)
+    for name in names:
+        print(f"\nCurrent partition table for /dev/{name}:")
+        subprocess.run(["fdisk", "-l", f"/dev/{name}"], check=False)
+    return names
 
-    if not confirm(f"Proceed to create GPT with 256MB EFI, 4G swap, and rest root on {disk_path}?"):
+
+def confirm_wipe(plan: LayoutPlan, unattended: bool | None = None) -> None:
+    print(f"\n{plan.describe()}")
+    disks = ", ".join(disk_plan.disk.path for disk_plan in plan.all_disks())
+    if not confirm(f"Proceed to wipe {disks} and apply this layout?", unattended=unattended):
         print("Aborted.")
         sys.exit(0)
 
-    print("\nPartitioning...")
-    run_command(["fdisk", disk_path], input_text=FDISK_TEMPLATE)
-
-    print("\nResulting partition table:")
-    subprocess.run(["fdisk", "-l", disk_path], check=False)
-
-    if re.fullmatch("sd.", name):
-        part1 = f"{disk_path}1"
-        part2 = f"{disk_path}2"
-        part3 = f"{disk_path}3"
-    else:
-        part1 = f"{disk_path}p1"
-        part2 = f"{disk_path}p2"
-        part3 = f"{disk_path}p3"
-    print(f"\nUsing partitions: {part1}, {part2}, {part3}")
-    
-    run_command(["mkfs.fat", "-F32", part1])
-    run_command(["mkswap", part2])
-    run_command(["swapon", part2])
-    run_command(["mkfs.btrfs", part3])
-
-    run_command(["mount", part3, "/mnt"])
-    run_command(["btrfs", "subvolume", "create", "/mnt/@"])
-    run_command(["btrfs", "subvolume", "create", "/mnt/@home"])
-    run_command(["btrfs", "subvolume", "create", "/mnt/@var"])
-    run_command(["btrfs", "subvolume", "create", "/mnt/@snapshots"])
+
+def discard_disk(disk: DiskInfo) -> None:
+    """TRIM the whole drive so a reused SSD starts with every block known free.
+
+    Best effort: a drive that does not support discard, or whose USB bridge rejects
+    it, is only reported; partitioning overwrites it either way.
+    """
+    if not disk.discard:
+        print(f"{disk.path} does not support discard, skipping.")
+        return
+    # -f: the old partition table and filesystem signatures are about to go anyway
+    if try_command(["blkdiscard", "-f", disk.path], timeout=DISCARD_TIMEOUT) != 0:
+        print(f"Warning: blkdiscard {disk.path} failed; continuing without discard.")
+
+
+def partition_disk(plan: LayoutPlan) -> None:
+    apply_layout(plan)
+
+    for disk_plan in plan.all_disks():
+        print(f"\nResulting partition table for {disk_plan.disk.path}:")
+        subprocess.run(["fdisk", "-l", disk_plan.disk.path], check=False)
+
+
+def format_efi(efi: str) -> None:
+    run_command(["mkfs.fat", "-F32", efi])
+
+
+def enable_swap(swap: str) -> None:
+    run_command(["mkswap", swap])
+    run_command(["swapon", swap])
+
+
+def activate_swap(swap: str) -> None:
+    """swapon an existing swap partition; it may already be active on a rerun."""
+    subprocess.run(["swapon", swap], stderr=subprocess.DEVNULL, check=False)
+
+
+def format_root(devices: list[str], data_profile: str | None = None, metadata_profile: str | None = None,
+                discarded: bool = False) -> None:
+    """Create the btrfs root; several devices form one multi-device filesystem.
+
+    mkfs.btrfs trims each device one after the other; with discarded=True the
+    drives were already trimmed in parallel, so that pass is skipped.
+    """
+    profile_flags = ["--nodiscard"] if discarded else []
+    if data_profile is not None:
+        profile_flags += ["-d", data_profile]
+    if metadata_profile is not None:
+        profile_flags += ["-m", metadata_profile]
+    run_command(["mkfs.btrfs", *profile_flags, *devices])
+
+
+def create_subvolumes(root: str, layout: MountLayout) -> None:
+    run_command(["mount", root, "/mnt"])
+    for subvolume in layout.subvolumes:
+        path = f"/mnt/{subvolume.name}"
+        # @ and @var may already have been received from a btrfs image
+        if Path(path).exists():
+            continue
+        run_command(["btrfs", "subvolume", "create", path])
+        if subvolume.nodatacow:
+            # Only takes effect on an empty directory; new files inherit it
+            run_command(["chattr", "+C", path])
+        if subvolume.compression is not None:
+            run_command(["btrfs", "property", "set", path, "compression", subvolume.compression])
     run_command(["umount", "/mnt"])
 
-    run_command(["mount", "-o", "noatime,compress=lzo,space_cache=v2,subvol=@", part3, "/mnt"])
-    run_command(["mkdir", "-p", "/mnt/boot", "/mnt/var", "/mnt/home", "/mnt/.snapshots"])
-    run_command(["mount", "-o", "noatime,compress=lzo,space_cache=v2,subvol=@home", part3, "/mnt/home"])
-    run_command(["mount", "-o", "noatime,compress=lzo,space_cache=v2,subvol=@var", part3, "/mnt/var"])
-    run_command(["mount", "-o", "noatime,compress=lzo,space_cache=v2,subvol=@snapshots", part3, "/mnt/.snapshots"])
-    run_command(["mount", part1, "/mnt/boot"])
\ No newline at end of file
+
+def mount_target(efi: str, root: str, layout: MountLayout) -> None:
+    for subvolume in layout.mount_order():
+        run_command(["mkdir", "-p", subvolume.target])
+        run_command(["mount", "-o", layout.mount_options(subvolume), root, subvolume.target])
+    run_command(["mkdir", "-p", "/mnt/boot"])
+    run_command(["mount", efi, "/mnt/boot"])
+
+
+def remount_target(efi: str, swap: str | None, root: str, layout: MountLayout) -> None:
+    """Bring back the mounts and swap of an earlier, interrupted install without formatting.
+
+    swap is a partition or a swapfile below /mnt, so it is activated after mounting.
+    """
+    # Make every member of a multi-device root known to the kernel before mounting
+    subprocess.run(["btrfs", "device", "scan"], check=False)
+    mount_target(efi, root, layout)
+    if swap is not None and Path(swap).exists():
+        subprocess.run(["swapon", swap], check=False)
+
+
+def release_target(swap: str | None) -> None:
+    """Deactivate swap and unmount /mnt, so a rerun or --resume starts from a clean host."""
+    if swap is not None:
+        subprocess.run(["swapoff", swap], stderr=subprocess.DEVNULL, check=False)
+    subprocess.run(["umount", "-R", "/mnt"], check=False)
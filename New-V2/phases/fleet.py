@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+import atexit
+import hmac
+import json
+import sys
+import threading
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+from dataclasses import asdict
+from dataclasses import dataclass
+from http.server import BaseHTTPRequestHandler
+from http.server import ThreadingHTTPServer
+from pathlib import Path
+
+from .config import check_config_keys
+from .events import EVENTS
+
+CONTROLLER_PORT = 7879
+# How long a client waits before asking again for a free install slot
+RETRY_AFTER = 15
+# An installing host that sent nothing for this long is assumed dead and loses its slot
+STALE_SECONDS = 30 * 60
+# Tokens shorter than this are too easy to guess from a LAN that can already see the controller
+MIN_TOKEN_LENGTH = 16
+
+
+@dataclass
+class HostStatus:
+    id: str
+    hostname: str
+    state: str = "pending"  # pending, waiting, installing, done, failed
+    phase: str | None = None
+    started: float | None = None
+    updated: float | None = None
+    failed_command: str | None = None
+
+
+def host_config(defaults: dict, host: dict) -> dict:
+    """Per-host install config: the fleet defaults overlaid with the host entry; options merge key by key."""
+    config = {**defaults, **{k: v for k, v in host.items() if k != "id"}}
+    config["options"] = {**defaults.get("options", {}), **host.get("options", {})}
+    return config
+
+
+class Fleet:
+    """Install slots and progress of every host the controller knows about."""
+
+    def __init__(self, defaults: dict, hosts: list[dict], max_concurrent: int, token: str,
+                 retry_failed: bool = False):
+        self.configs = {host["id"].lower(): host_config(defaults, host) for host in hosts}
+        self.status = {host_id: HostStatus(host_id, config.get("hostname", host_id))
+                       for host_id, config in self.configs.items()}
+        self.max_concurrent = max_concurrent
+        # Configs carry the passwords, so every request must present the fleet file's token
+        self.token = token
+        # Failed hosts are only installed again when the fleet file asks for it
+        self.retry_failed = retry_failed
+        self.lock = threading.Lock()
+
+    def _release_stale(self, now: float) -> None:
+        for status in self.status.values():
+            if status.state == "installing" and now - (status.updated or now) > STALE_SECONDS:
+                print(f"{status.hostname:<16} no progress for {STALE_SECONDS // 60} min, releasing its slot")
+                status.state = "failed"
+
+    def claim(self, host_id: str) -> tuple[str, dict | None]:
+        """Ask for an install slot: ("install", config), ("wait", None), or ("done"/"failed", None).
+
+        A finished host that PXE-boots into the installer again must not have its
+        disk wiped a second time, so "done" is final; "failed" is too unless the
+        fleet file sets "retry_failed".
+        """
+        now = time.time()
+        with self.lock:
+            status = self.status[host_id]
+            self._release_stale(now)
+            if status.state == "done" or (status.state == "failed" and not self.retry_failed):
+                return status.state, None
+            installing = sum(1 for s in self.status.values() if s.state == "installing")
+            # A host that reboots into the installer again keeps the slot it already has
+            if status.state != "installing" and installing >= self.max_concurrent:
+                status.state = "waiting"
+                return "wait", None
+            if status.state != "installing":
+                print(f"{status.hostname:<16} install started ({installing + 1}/{self.max_concurrent} slots)")
+            status.state, status.phase, status.failed_command = "installing", None, None
+            status.started = status.updated = now
+            return "install", self.configs[host_id]
+
+    def record(self, host_id: str, event: dict) -> None:
+        with self.lock:
+            status = self.status[host_id]
+            status.updated = time.time()
+            kind = event.get("event")
+            if kind == "phase_start":
+                status.phase = event.get("phase")
+            elif kind == "phase_end":
+                print(f"{status.hostname:<16} {event.get('phase')} {'done' if event.get('ok') else 'FAILED'} "
+                      f"in {event.get('duration', 0):.1f}s")
+            elif kind == "command" and event.get("exit_code"):
+                status.failed_command = " ".join(event.get("command", []))
+            elif kind == "finished":
+                status.state = "done" if event.get("ok") else "failed"
+                status.phase = None
+                print(f"{status.hostname:<16} install {status.state} after {status.updated - status.started:.0f}s")
+
+    def all_finished(self) -> bool:
+        with self.lock:
+            return all(s.state in {"done", "failed"} for s in self.status.values())
+
+    def summary(self) -> list[dict]:
+        with self.lock:
+            return [asdict(status) for status in self.status.values()]
+
+
+class _ControllerHandler(BaseHTTPRequestHandler):
+    fleet: Fleet
+
+    def log_message(self, format: str, *args) -> None:
+        pass
+
+    def _authorized(self) -> bool:
+        header = self.headers.get("Authorization", "")
+        if hmac.compare_digest(header.encode(), f"Bearer {self.fleet.token}".encode()):
+            return True
+        self._send_json(401, {"error": "missing or wrong controller token"})
+        return False
+
+    def _host_id(self) -> str | None:
+        query = urllib.parse.parse_qs(urllib.parse.urlsplit(self.path).query)
+        host_id = query.get("id", [""])[0].lower()
+        if host_id not in self.fleet.configs:
+            self._send_json(404, {"error": f"unknown host id '{host_id}'"})
+            return None
+        return host_id
+
+    def _send_json(self, code: int, body, headers: dict | None = None) -> None:
+        data = json.dumps(body).encode()
+        self.send_response(code)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        for key, value in (headers or {}).items():
+            self.send_header(key, value)
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self) -> None:
+        if not self._authorized():
+            return
+        route = urllib.parse.urlsplit(self.path).path
+        if route == "/status":
+            self._send_json(200, self.fleet.summary())
+        elif route == "/config":
+            host_id = self._host_id()
+            if host_id is None:
+                return
+            answer, config = self.fleet.claim(host_id)
+            if answer == "wait":
+                self._send_json(503, {"error": "all install slots are busy"}, {"Retry-After": str(RETRY_AFTER)})
+            elif answer == "done":
+                self._send_json(410, {"error": "host is already installed"})
+            elif answer == "failed":
+                self._send_json(409, {"error": "the last install of this host failed; set retry_failed to install it again"})
+            else:
+                self._send_json(200, config)
+        else:
+            self._send_json(404, {"error": "not found"})
+
+    def do_POST(self) -> None:
+        if not self._authorized():
+            return
+        if urllib.parse.urlsplit(self.path).path != "/events":
+            self._send_json(404, {"error": "not found"})
+            return
+        host_id = self._host_id()
+        if host_id is None:
+            return
+        try:
+            event = json.loads(self.rfile.read(int(self.headers.get("Content-Length", 0))))
+        except (ValueError, json.JSONDecodeError):
+            self._send_json(400, {"error": "invalid event"})
+            return
+        self.fleet.record(host_id, event)
+        self._send_json(200, {})
+
+
+def load_fleet(path: Path) -> Fleet:
+    """Read the fleet file and check every host's merged config before any machine boots."""
+    try:
+        fleet = json.loads(path.read_text())
+    except (OSError, json.JSONDecodeError) as e:
+        print(f"Error reading fleet file {path}: {e}")
+        sys.exit(1)
+    hosts = fleet.get("hosts", [])
+    if not hosts or any("id" not in host for host in hosts):
+        print(f"Error: {path} needs a \"hosts\" list whose entries each have an \"id\" (MAC address).")
+        sys.exit(1)
+    ids = [host["id"].lower() for host in hosts]
+    if len(set(ids)) != len(ids):
+        print(f"Error: duplicate host ids in {path}.")
+        sys.exit(1)
+    token = fleet.get("token")
+    if not isinstance(token, str) or len(token) < MIN_TOKEN_LENGTH or token.startswith("CHANGE_ME"):
+        print(f"Error: {path} needs a \"token\" of at least {MIN_TOKEN_LENGTH} characters; installers pass it "
+              f"with --controller-token (e.g. generate one with: openssl rand -hex 16).")
+        sys.exit(1)
+    defaults = fleet.get("defaults", {})
+    for host in hosts:
+        check_config_keys(host_config(defaults, host), f"{path} ({host['id']})")
+    return Fleet(defaults, hosts, max(1, int(fleet.get("max_concurrent", 8))), token,
+                 fleet.get("retry_failed") is True)
+
+
+def serve_controller(fleet_path: Path, port: int) -> None:
+    """Hand out per-host configs to installers and follow their progress until every host finished."""
+    fleet = load_fleet(fleet_path)
+    _ControllerHandler.fleet = fleet
+    server = ThreadingHTTPServer(("", port), _ControllerHandler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print(f"Controller for {len(fleet.configs)} host(s) on port {port}, "
+          f"{fleet.max_concurrent} at a time (clients: --controller http://<this host>:{port})")
+    try:
+        while not fleet.all_finished():
+            time.sleep(2)
+    except KeyboardInterrupt:
+        print("Stopping controller")
+    finally:
+        server.shutdown()
+        server.server_close()
+
+    print(f"\n{'Host':<16} {'State':<11} {'Last phase / failed command'}")
+    failed = False
+    for status in fleet.summary():
+        failed = failed or status["state"] != "done"
+        print(f"{status['hostname']:<16} {status['state']:<11} {status['failed_command'] or status['phase'] or ''}")
+    if failed:
+        sys.exit(1)
+
+
+def local_host_id() -> str:
+    """MAC address of the first physical network interface, the id the fleet file uses."""
+    for interface in sorted(Path("/sys/class/net").iterdir()):
+        address_path = interface / "address"
+        if interface.name == "lo" or not (interface / "device").exists() or not address_path.exists():
+            continue
+        address = address_path.read_text().strip()
+        if address and address != "00:00:00:00:00:00":
+            return address
+    print("Error: no network interface with a MAC address found; pass --host-id.")
+    sys.exit(1)
+
+
+def _auth_headers(token: str) -> dict:
+    return {"Authorization": f"Bearer {token}"}
+
+
+def request_config(controller: str, host_id: str, token: str) -> dict:
+    """Fetch this host's install config, waiting while all of the controller's slots are busy."""
+    url = f"{controller.rstrip('/')}/config?id={urllib.parse.quote(host_id)}"
+    request = urllib.request.Request(url, headers=_auth_headers(token))
+    while True:
+        try:
+            with urllib.request.urlopen(request, timeout=30) as response:
+                config = json.loads(response.read().decode())
+            break
+        except urllib.error.HTTPError as e:
+            if e.code == 410:
+                # Booted into the installer again after a finished install: leave the disk alone
+                print(f"The controller reports host {host_id} as already installed; nothing to do.")
+                sys.exit(0)
+            if e.code != 503:
+                print(f"Error: controller refused host {host_id}: {e.code} {e.read().decode(errors='replace')}")
+                sys.exit(1)
+            delay = int(e.headers.get("Retry-After", RETRY_AFTER))
+            print(f"All install slots busy, asking the controller again in {delay}s")
+            time.sleep(delay)
+        except (urllib.error.URLError, OSError, json.JSONDecodeError) as e:
+            print(f"Controller {controller} unreachable ({e}), retrying in {RETRY_AFTER}s")
+            time.sleep(RETRY_AFTER)
+    check_config_keys(config, url)
+    return config
+
+
+class ProgressReporter:
+    """Forward phase and command events to the controller; losing one never stops the install.
+
+    It is a sink of the event stream, so a slow controller only delays the background writer.
+    """
+
+    def __init__(self, controller: str, host_id: str, token: str):
+        self.url = f"{controller.rstrip('/')}/events?id={urllib.parse.quote(host_id)}"
+        self.token = token
+        self.finished = False
+        EVENTS.add_sink(self.send)
+        # Also reached through sys.exit() on an error before the install steps ran
+        atexit.register(self.finish, False)
+
+    def send(self, event: dict) -> None:
+        # Output lines stay in the node's own log; the controller only tracks progress
+        if event["event"] in {"output", "download"}:
+            return
+        request = urllib.request.Request(self.url, data=json.dumps(event).encode(),
+                                         headers={"Content-Type": "application/json", **_auth_headers(self.token)})
+        try:
+            urllib.request.urlopen(request, timeout=2).close()
+        except (urllib.error.URLError, OSError):
+            pass
+
+    def finish(self, ok: bool) -> None:
+        if not self.finished:
+            self.finished = True
+            self.send({"event": "finished", "ok": ok})
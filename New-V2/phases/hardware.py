@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+from pathlib import Path
+
+PCI_DEVICES = Path("/sys/bus/pci/devices")
+DISPLAY_CLASS = 0x03  # PCI base class of VGA, 3D and other display controllers
+
+VENDOR_NVIDIA = 0x10DE
+VENDOR_AMD = 0x1002
+VENDOR_INTEL = 0x8086
+VENDOR_VIRTUALBOX = 0x80EE
+# VMware SVGA, virtio-gpu and the QEMU/Bochs standard VGA
+VM_VENDORS = {0x15AD, 0x1AF4, 0x1234}
+
+# Turing (TU1xx, 0x1e00) and newer have the GSP the open kernel modules need;
+# Maxwell (0x1340) up to Volta still need the proprietary modules; older cards only have nouveau
+NVIDIA_OPEN_MIN_DEVICE = 0x1E00
+NVIDIA_PROPRIETARY_MIN_DEVICE = 0x1340
+
+MICROCODE = {
+    "GenuineIntel": "intel-ucode",
+    "AuthenticAMD": "amd-ucode",
+}
+
+
+def _read_hex(path: Path) -> int:
+    try:
+        return int(path.read_text().strip(), 16)
+    except (OSError, ValueError):
+        return 0
+
+
+def display_devices() -> list[tuple[int, int]]:
+    """(vendor, device) ids of every display controller, as lspci -nn shows them."""
+    devices = []
+    if not PCI_DEVICES.is_dir():
+        return devices
+    for device in sorted(PCI_DEVICES.iterdir()):
+        if _read_hex(device / "class") >> 16 == DISPLAY_CLASS:
+            devices.append((_read_hex(device / "vendor"), _read_hex(device / "device")))
+    return devices
+
+
+def cpu_vendor() -> str | None:
+    try:
+        for line in Path("/proc/cpuinfo").read_text().splitlines():
+            if line.startswith("vendor_id"):
+                return line.split(":", 1)[1].strip()
+    except OSError:
+        pass
+    return None
+
+
+def microcode_package() -> str | None:
+    return MICROCODE.get(cpu_vendor() or "")
+
+
+def _gpu_group(vendor: int, device: int) -> str | None:
+    if vendor == VENDOR_NVIDIA:
+        if device >= NVIDIA_OPEN_MIN_DEVICE:
+            return "gpu-nvidia-open"
+        return "gpu-nvidia" if device >= NVIDIA_PROPRIETARY_MIN_DEVICE else "gpu-mesa"
+    if vendor == VENDOR_AMD:
+        return "gpu-amd"
+    if vendor == VENDOR_INTEL:
+        return "gpu-intel"
+    if vendor == VENDOR_VIRTUALBOX:
+        return "gpu-virtualbox"
+    if vendor in VM_VENDORS:
+        return "gpu-vm"
+    return None
+
+
+def detect_gpu_groups() -> list[str]:
+    """Manifest GPU groups for every display controller, e.g. gpu-intel + gpu-nvidia-open on a hybrid laptop."""
+    groups = [_gpu_group(vendor, device) for vendor, device in display_devices()]
+    return list(dict.fromkeys(group for group in groups if group is not None))
+
+
+def hardware_summary() -> dict:
+    """Detected ids for the install report, so a wrong driver pick can be traced back."""
+    return {
+        "cpu_vendor": cpu_vendor(),
+        "microcode": microcode_package(),
+        "display_devices": [f"{vendor:04x}:{device:04x}" for vendor, device in display_devices()],
+        "gpu_groups": detect_gpu_groups(),
+    }
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+import subprocess
+import sys
+from pathlib import Path
+
+from .library import pipeline
+from .library import run_command
+from .library import try_command
+from .mount_layout import MountLayout
+
+IMAGE_STAGING = "/mnt/.image"
+# Subvolumes a btrfs image may carry; anything not in the stream is created empty
+IMAGE_SUBVOLUMES = ["@", "@var"]
+
+
+def is_btrfs_image(image: str) -> bool:
+    return image.removesuffix(".zst").endswith(".btrfs")
+
+
+def _image_source(image: str) -> list[list[str]]:
+    """Download/decompression stages whose output is the raw image."""
+    if image.startswith(("http://", "https://")):
+        stages = [["curl", "-fsSL", image]]
+    else:
+        if not Path(image).is_file():
+            print(f"Error: image {image} does not exist.")
+            sys.exit(1)
+        stages = [["cat", image]]
+    if image.endswith(".zst"):
+        stages.append(["zstd", "-dc", "-T0"])
+    return stages
+
+
+def _run_pipeline(image: str, consumer: list[str]) -> None:
+    # One runner command, so Ctrl-C and the report reach the download and the consumer alike
+    if try_command(pipeline(_image_source(image) + [consumer])) != 0:
+        print(f"Image deployment failed: {' '.join(consumer)}")
+        sys.exit(1)
+
+
+def receive_image(root: str, image: str, layout: MountLayout) -> None:
+    """Receive a btrfs send stream onto the new filesystem as writable @ (and @var if present).
+
+    The stream is expected to contain read-only snapshots named @ and optionally @var,
+    e.g. created with `btrfs send /.snapshots/@ /.snapshots/@var | zstd > golden.btrfs.zst`.
+    """
+    # With the layout's compress= option, so the received files are stored like a pacstrap install's
+    run_command(["mount", *layout.top_level_options(), root, "/mnt"])
+    try:
+        run_command(["mkdir", "-p", IMAGE_STAGING])
+        _run_pipeline(image, ["btrfs", "receive", IMAGE_STAGING])
+        for name in IMAGE_SUBVOLUMES:
+            received = Path(IMAGE_STAGING) / name
+            if received.is_dir():
+                run_command(["btrfs", "subvolume", "snapshot", str(received), f"/mnt/{name}"])
+                run_command(["btrfs", "subvolume", "delete", str(received)])
+        if not Path("/mnt/@").is_dir():
+            print("Error: the btrfs image does not contain an @ subvolume.")
+            sys.exit(1)
+        run_command(["rmdir", IMAGE_STAGING])
+    finally:
+        subprocess.run(["umount", "/mnt"], check=False)
+
+
+def extract_image(image: str) -> None:
+    """Unpack a (zstd) tarball of a root filesystem into the mounted target layout.
+
+    /boot is skipped: the EFI partition is FAT, and the kernel and initramfs are
+    regenerated for this host by the chroot step anyway.
+    """
+    _run_pipeline(image, [
+        "tar", "-xpf", "-", "-C", "/mnt", "--numeric-owner", "--xattrs", "--xattrs-include=*", "--acls",
+        "--anchored", "--exclude=boot/*", "--exclude=./boot/*",
+    ])
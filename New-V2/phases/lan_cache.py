@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+import socket
+import threading
+import time
+import urllib.error
+import urllib.request
+from http.server import BaseHTTPRequestHandler
+from http.server import ThreadingHTTPServer
+from pathlib import Path
+
+from .mirrors import MIRRORLIST
+
+BEACON_PORT = 7743
+BEACON_PREFIX = "arch-install-cache "
+BEACON_INTERVAL = 2
+LAN_MARKER = "# LAN package cache"
+CHUNK_SIZE = 1 << 16
+
+# Sync databases change on every mirror sync, so they are proxied but never stored
+_UNCACHED_SUFFIXES = (".db", ".db.sig", ".files", ".files.sig")
+
+
+class _Download:
+    """A package fetch in progress; other clients stream the partial file while it grows."""
+
+    def __init__(self, cached: Path):
+        self.cached = cached
+        self.temp_path = cached.with_name(f".{cached.name}.part")
+        self.length = 0
+        self.started = threading.Event()
+        self.done = threading.Event()
+        self.failed = False
+
+
+class _CacheHandler(BaseHTTPRequestHandler):
+    cache_dir: Path = Path("/var/cache/pacman/pkg")
+    upstreams: list[str] = []
+    downloads: dict[str, _Download] = {}
+    downloads_lock = threading.Lock()
+
+    def log_message(self, format: str, *args) -> None:
+        print(f"[cache] {self.address_string()} {format % args}")
+
+    def do_GET(self) -> None:
+        # Clients use Server = http://host:port/$repo/os/$arch
+        parts = self.path.split("?", 1)[0].strip("/").split("/")
+        if len(parts) != 4 or parts[1] != "os" or parts[3] in {"", ".", ".."}:
+            self.send_error(404)
+            return
+        repo, _, arch, filename = parts
+
+        if filename.endswith(_UNCACHED_SUFFIXES):
+            response = self._open_upstream(repo, arch, filename)
+            if response is None:
+                self.send_error(404)
+                return
+            with response:
+                self._send_stream(response, int(response.headers.get("Content-Length", 0)))
+            return
+
+        cached = self.cache_dir / filename
+        if cached.exists():
+            with cached.open("rb") as source:
+                self._send_stream(source, cached.stat().st_size)
+            return
+
+        with self.downloads_lock:
+            download = self.downloads.get(filename)
+            owner = download is None
+            if owner:
+                download = _Download(cached)
+                self.downloads[filename] = download
+
+        if owner:
+            self._fetch_and_send(repo, arch, filename, download)
+        else:
+            self._follow(download)
+
+    def _open_upstream(self, repo: str, arch: str, filename: str):
+        for server in self.upstreams:
+            url = server.replace("$repo", repo).replace("$arch", arch).rstrip("/") + "/" + filename
+            try:
+                return urllib.request.urlopen(url, timeout=15)
+            except (urllib.error.URLError, OSError):
+                continue
+        return None
+
+    def _fetch_and_send(self, repo: str, arch: str, filename: str, download: _Download) -> None:
+        response = self._open_upstream(repo, arch, filename)
+        if response is None:
+            download.failed = True
+            download.started.set()
+            download.done.set()
+            with self.downloads_lock:
+                self.downloads.pop(filename, None)
+            self.send_error(404)
+            return
+
+        download.length = int(response.headers.get("Content-Length", 0))
+        client_alive = True
+        received = 0
+        try:
+            with response, download.temp_path.open("wb") as sink:
+                download.started.set()
+                self._send_headers(download.length)
+                while chunk := response.read(CHUNK_SIZE):
+                    sink.write(chunk)
+                    sink.flush()
+                    received += len(chunk)
+                    if client_alive:
+                        try:
+                            self.wfile.write(chunk)
+                        except OSError:
+                            # Keep filling the cache for the next machine
+                            client_alive = False
+                # read() returns b"" when the upstream hangs up early; a short file must never
+                # become a cached package that every later machine gets
+                if download.length and received < download.length:
+                    raise OSError(f"upstream closed after {received} of {download.length} bytes")
+            download.temp_path.rename(download.cached)
+        except OSError as e:
+            print(f"[cache] upstream fetch of {filename} failed: {e}")
+            download.failed = True
+            download.temp_path.unlink(missing_ok=True)
+            # The headers are out, so closing short of Content-Length is the client's error
+            self.close_connection = True
+        finally:
+            download.started.set()
+            download.done.set()
+            with self.downloads_lock:
+                self.downloads.pop(filename, None)
+
+    def _follow(self, download: _Download) -> None:
+        download.started.wait()
+        if download.failed:
+            self.send_error(404)
+            return
+        try:
+            source = download.temp_path.open("rb")
+        except FileNotFoundError:
+            source = download.cached.open("rb")
+        self._send_headers(download.length)
+        sent = 0
+        try:
+            with source:
+                while True:
+                    chunk = source.read(CHUNK_SIZE)
+                    if chunk:
+                        self.wfile.write(chunk)
+                        sent += len(chunk)
+                    elif download.done.is_set() and (download.failed or sent >= download.length):
+                        if download.failed:
+                            self.close_connection = True
+                        break
+                    else:
+                        time.sleep(0.05)
+        except OSError:
+            pass
+
+    def _send_headers(self, length: int) -> None:
+        self.send_response(200)
+        self.send_header("Content-Type", "application/octet-stream")
+        if length:
+            self.send_header("Content-Length", str(length))
+        self.end_headers()
+
+    def _send_stream(self, source, length: int) -> None:
+        self._send_headers(length)
+        try:
+            while chunk := source.read(CHUNK_SIZE):
+                self.wfile.write(chunk)
+        except OSError:
+            pass
+
+
+def upstream_servers(mirrorlist: Path = MIRRORLIST) -> list[str]:
+    servers = []
+    for line in mirrorlist.read_text().splitlines():
+        if LAN_MARKER in line:
+            continue
+        line = line.split("#", 1)[0].strip()
+        if line.startswith("Server") and "=" in line:
+            servers.append(line.split("=", 1)[1].strip())
+    return servers
+
+
+def _broadcast_beacon(port: int) -> None:
+    message = f"{BEACON_PREFIX}{port}".encode()
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+        while True:
+            try:
+                sock.sendto(message, ("<broadcast>", BEACON_PORT))
+            except OSError:
+                pass
+            time.sleep(BEACON_INTERVAL)
+
+
+def serve_cache(cache_dir: Path, port: int) -> None:
+    """Serve cache_dir as a caching pacman mirror and announce it on the LAN until interrupted.
+
+    Packages missing from the cache are fetched once from this host's mirrorlist,
+    streamed to the client and stored, so every other machine gets them over the LAN.
+    """
+    cache_dir.mkdir(parents=True, exist_ok=True)
+    _CacheHandler.cache_dir = cache_dir
+    _CacheHandler.upstreams = upstream_servers()
+    server = ThreadingHTTPServer(("", port), _CacheHandler)
+    threading.Thread(target=_broadcast_beacon, args=(port,), daemon=True).start()
+    print(f"Serving {cache_dir} on port {port} (clients: --lan-cache auto)")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        print("Stopping package cache server")
+    finally:
+        server.server_close()
+
+
+def discover_lan_cache(timeout: float = 5) -> str | None:
+    """Listen for a cache server beacon and return its base URL, or None if none is heard."""
+    with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as sock:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        sock.bind(("", BEACON_PORT))
+        sock.settimeout(timeout)
+        try:
+            while True:
+                data, (address, _) = sock.recvfrom(256)
+                text = data.decode(errors="replace")
+                if text.startswith(BEACON_PREFIX):
+                    return f"http://{address}:{text[len(BEACON_PREFIX):].strip()}"
+        except (socket.timeout, OSError):
+            return None
+
+
+def use_lan_cache(url: str, mirrorlist: Path = MIRRORLIST) -> None:
+    """Put the LAN cache server at the top of the mirrorlist so pacman tries it first."""
+    remove_lan_cache(mirrorlist)
+    line = f"Server = {url.rstrip('/')}/$repo/os/$arch {LAN_MARKER}\n"
+    mirrorlist.write_text(line + mirrorlist.read_text())
+    print(f"Using LAN package cache {url}")
+
+
+def remove_lan_cache(mirrorlist: Path) -> None:
+    if not mirrorlist.exists():
+        return
+    lines = mirrorlist.read_text().splitlines(keepends=True)
+    mirrorlist.write_text("".join(line for line in lines if LAN_MARKER not in line))
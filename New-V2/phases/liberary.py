@@ -1,3 +0,0 @@
-#!/usr/bin/env python3
-# Compatibility shim: keep old import path working
-from .library import run_command, confirm, write_file  # noqa: F401
\ No newline at end of file
@@ -1,32 +1,280 @@
 #!/usr/bin/env python3
+import asyncio
 import os
+import shlex
+import signal
 import subprocess
 import sys
+import threading
+import time
 from pathlib import Path
+from typing import Callable
 
-def run_command(command: list[str], input_text: str | None = None) -> None:
-    """Run a command and exit on failure.
+from .events import EVENTS
+from .events import OutputLines
+from .report import CommandRecord
+from .report import track_command
+
+RETRY_BASE_DELAY = 5
+RETRY_MAX_DELAY = 60
+# Exit code of a command stopped by its timeout, as with timeout(1)
+TIMEOUT_EXIT_CODE = 124
+# Seconds between SIGTERM and SIGKILL for a timed-out or cancelled command
+KILL_GRACE = 10
+
+# Commands running right now, for cancel_commands(): pid -> whether it leads its own process group
+_running: dict[int, bool] = {}
+_running_lock = threading.Lock()
+
+def run_command(
+    command: list[str],
+    input_text: str | None = None,
+    retries: int = 0,
+    before_retry: Callable[[], None] | None = None,
+    timeout: float | None = None,
+) -> None:
+    """Run a command and exit on failure, recording its timing in the install report.
 
     Args:
         command: Command and arguments to execute.
         input_text: Optional stdin text to pass to the process.
+        retries: Extra attempts after a non-zero exit, with exponential backoff.
+            Only for network-bound commands; everything else should fail fast.
+        before_retry: Called before each retry, e.g. to rotate the mirrorlist.
+        timeout: Seconds before the command is stopped and counts as failed; None waits forever.
+    """
+    for attempt in range(retries + 1):
+        returncode = try_command(command, input_text, timeout)
+        if returncode == 0:
+            return
+        if attempt == retries or returncode == 127:
+            joined = " ".join(command)
+            print(f"Command failed: {joined}\nExit code: {returncode}")
+            sys.exit(returncode)
+        delay = min(RETRY_BASE_DELAY * 2 ** attempt, RETRY_MAX_DELAY)
+        print(f"{command[0]} failed with exit code {returncode}, retrying in {delay}s ({attempt + 1}/{retries})")
+        if before_retry is not None:
+            before_retry()
+        time.sleep(delay)
+
+def try_command(command: list[str], input_text: str | None = None, timeout: float | None = None) -> int:
+    """Run a command like run_command, but return its exit code instead of exiting on failure."""
+    with track_command(command) as record:
+        try:
+            record.exit_code = asyncio.run(run_async(command, input_text, timeout, record))
+        except FileNotFoundError as e:
+            record.exit_code = 127
+            print(f"Command not found: {command[0]} ({e})")
+        return record.exit_code
+
+def capture_command(command: list[str], timeout: float | None = None) -> tuple[int, str]:
+    """Run a probe (curl -w, fio, compsize, ...) like try_command and return its exit code and stdout.
+
+    Unlike command_output, the probe is timed in the report, stopped by its timeout
+    and cancelled with the other commands. Its stderr goes to the event stream.
+    """
+    output = bytearray()
+    with track_command(command) as record:
+        try:
+            record.exit_code = asyncio.run(run_async(command, timeout=timeout, record=record, output=output))
+        except FileNotFoundError as e:
+            record.exit_code = 127
+            print(f"Command not found: {command[0]} ({e})")
+        return record.exit_code, output.decode(errors="replace")
+
+def pipeline(stages: list[list[str]]) -> list[str]:
+    """One command for `stage | stage | ...`, so the runner times, stops and accounts for it as a whole.
+
+    pipefail makes a failing download or decompressor fail the pipeline, not just its last stage.
+    """
+    return ["bash", "-o", "pipefail", "-c", " | ".join(shlex.join(stage) for stage in stages)]
+
+async def run_async(command: list[str], input_text: str | None = None, timeout: float | None = None,
+                    record: CommandRecord | None = None, output: bytearray | None = None) -> int:
+    """Run command on the current event loop and return its exit code.
+
+    Output goes through the event stream once it is started; with output, stdout is
+    collected there instead. The command then gets its own process group, so a timeout
+    or cancellation stops everything it spawned (pacstrap's pacman and curl, ...).
+    Before that it keeps the terminal, and only the command itself is stopped. The
+    child is reaped with os.wait4, which puts its CPU time, peak RSS and block I/O
+    into record.
+    """
+    capture = EVENTS.running
+    # A background process group reading the terminal would be stopped by SIGTTIN,
+    # so only commands without terminal input get one
+    process = subprocess.Popen(command, stdin=subprocess.PIPE if input_text is not None else
+                               subprocess.DEVNULL if capture else None,
+                               stdout=subprocess.PIPE if capture or output is not None else None,
+                               stderr=(subprocess.PIPE if output is not None else subprocess.STDOUT) if capture else None,
+                               process_group=0 if capture else None)
+    loop = asyncio.get_running_loop()
+    # Readable once the child exits; unlike a child watcher, it leaves reaping to us
+    pidfd = os.pidfd_open(process.pid)
+    exited = loop.create_future()
+    loop.add_reader(pidfd, lambda: exited.done() or exited.set_result(None))
+    register_process(process.pid, capture)
+    lines = OutputLines(command[0])
+    pipes = []
+    if output is not None:
+        pipes.append((process.stdout, output.extend))
+    if capture:
+        pipes.append((process.stderr if output is not None else process.stdout, lines.feed))
+    for pipe, sink in pipes:
+        _watch_output(loop, pipe.fileno(), sink)
+    feed = None
+    timed_out = False
+    try:
+        if input_text is not None:
+            # Written by the loop as the child reads, so a child that fills its output
+            # pipe before it drains stdin cannot stall the output reader
+            feed, _ = await loop.connect_write_pipe(asyncio.Protocol, process.stdin)
+            feed.write(input_text.encode())
+            feed.close()
+        try:
+            await asyncio.wait_for(asyncio.shield(exited), timeout)
+        except TimeoutError:
+            timed_out = True
+            print(f"Command timed out after {timeout:g}s: {' '.join(command)}")
+            await _stop(process.pid, capture, exited)
+        except asyncio.CancelledError:
+            await _stop(process.pid, capture, exited)
+            raise
+    finally:
+        for pipe, sink in pipes:
+            # Everything the command wrote is in the pipe by now. A daemon it started
+            # (gpg-agent, ...) may hold the pipe open for good, so take what is there, not EOF
+            loop.remove_reader(pipe.fileno())
+            _read_available(pipe.fileno(), sink)
+            pipe.close()
+        if feed is not None and feed.get_write_buffer_size():
+            # The command exited (or was stopped) without reading all of its input
+            feed.abort()
+        loop.remove_reader(pidfd)
+        os.close(pidfd)
+        process.returncode = reap_process(process.pid, record)
+        if record is not None:
+            record.timed_out = timed_out
+    tail = lines.close()
+    returncode = TIMEOUT_EXIT_CODE if timed_out else process.returncode
+    if returncode != 0 and EVENTS.quiet:
+        # Quiet consoles saw none of the output; show what led to the failure
+        print("\n".join(tail))
+    return returncode
+
+def _watch_output(loop: asyncio.AbstractEventLoop, fd: int, sink: Callable[[bytes], None]) -> None:
+    os.set_blocking(fd, False)
+
+    def readable() -> None:
+        if not _read_available(fd, sink):
+            loop.remove_reader(fd)
+
+    loop.add_reader(fd, readable)
+
+def _read_available(fd: int, sink: Callable[[bytes], None]) -> bool:
+    """Pass what a non-blocking pipe holds right now to sink; False once it reached EOF."""
+    while True:
+        try:
+            chunk = os.read(fd, 65536)
+        except BlockingIOError:
+            return True
+        if not chunk:
+            return False
+        sink(chunk)
+
+def register_process(pid: int, group: bool) -> None:
+    """Let cancel_commands() reach a process; group says whether it leads its own process group."""
+    with _running_lock:
+        _running[pid] = group
+
+def reap_process(pid: int, record: CommandRecord | None = None) -> int:
+    """Wait for a registered process with os.wait4 and return its exit code.
+
+    The rusage covers the process and every descendant it waited for; it goes into record.
+    """
+    _, status, usage = os.wait4(pid, 0)
+    with _running_lock:
+        _running.pop(pid, None)
+    if record is not None:
+        record.cpu_seconds = round(usage.ru_utime + usage.ru_stime, 3)
+        record.max_rss_bytes = usage.ru_maxrss * 1024
+        # ru_inblock/ru_oublock count 512-byte blocks that reached the block layer
+        record.read_bytes = usage.ru_inblock * 512
+        record.write_bytes = usage.ru_oublock * 512
+    return os.waitstatus_to_exitcode(status)
+
+def stop_process(pid: int, group: bool) -> None:
+    """SIGTERM a registered process from any thread, and SIGKILL it after KILL_GRACE if it is still running."""
+    _signal(pid, group, signal.SIGTERM)
+
+    def kill() -> None:
+        with _running_lock:
+            running = pid in _running
+        if running:
+            _signal(pid, group, signal.SIGKILL)
+
+    timer = threading.Timer(KILL_GRACE, kill)
+    timer.daemon = True
+    timer.start()
+
+def _signal(pid: int, group: bool, sig: int) -> None:
+    try:
+        if group:
+            os.killpg(pid, sig)
+        else:
+            os.kill(pid, sig)
+    except ProcessLookupError:
+        pass
+
+async def _stop(pid: int, group: bool, exited: asyncio.Future) -> None:
+    _signal(pid, group, signal.SIGTERM)
+    try:
+        await asyncio.wait_for(asyncio.shield(exited), KILL_GRACE)
+    except TimeoutError:
+        _signal(pid, group, signal.SIGKILL)
+        await exited
+
+def cancel_commands(sig: int = signal.SIGTERM) -> None:
+    """Signal every running command's process group, e.g. on Ctrl-C.
+
+    The commands then fail like any other, so their tasks end and the scheduler
+    can return instead of waiting on children that never saw the terminal's SIGINT.
     """
+    with _running_lock:
+        running = list(_running.items())
+    for pid, group in running:
+        _signal(pid, group, sig)
+
+def forward_interrupts() -> None:
+    """Pass Ctrl-C on to the commands, which run outside the terminal's process group."""
+    def interrupt(signum: int, frame) -> None:
+        cancel_commands(signal.SIGINT)
+        raise KeyboardInterrupt
+
+    signal.signal(signal.SIGINT, interrupt)
+
+def command_output(command: list[str]) -> str:
+    """Run a short query command (blkid, btrfs inspect-internal, ...) and return its stripped stdout."""
     try:
-        subprocess.run(
-            command,
-            check=True,
-            input=input_text,
-            text=True if input_text is not None else False,
-        )
-    except FileNotFoundError as e:
-        print(f"Command not found: {command[0]} ({e})")
-        sys.exit(127)
-    except subprocess.CalledProcessError as error:
-        joined = " ".join(command)
-        print(f"Command failed: {joined}\nExit code: {error.returncode}")
-        sys.exit(error.returncode)
-
-def confirm(prompt: str) -> bool:
+        return subprocess.run(command, check=True, capture_output=True, text=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError) as e:
+        print(f"Error running {' '.join(command)}: {e}")
+        sys.exit(1)
+
+# Set by main for --config installs: every confirm() takes its unattended answer
+UNATTENDED = False
+
+def confirm(prompt: str, unattended: bool | None = None) -> bool:
+    """Ask a yes/no question; without a TTY or in an unattended install, answer `unattended`.
+
+    Questions with no safe unattended answer (None) exit instead of blocking on input().
+    """
+    if UNATTENDED or not sys.stdin.isatty():
+        if unattended is None:
+            print(f"{prompt} Error: no answer in an unattended install.")
+            sys.exit(1)
+        print(f"{prompt} [y/N]: {'y' if unattended else 'n'} (unattended)")
+        return unattended
     answer = input(f"{prompt} [y/N]: ").strip().lower()
     return answer in {"y", "yes"}
 
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+import shutil
+import sys
+import time
+from pathlib import Path
+
+from .library import confirm
+from .library import try_command
+
+MIRRORLIST = Path("/etc/pacman.d/mirrorlist")
+# reflector has no overall deadline: a mirror that accepts the connection and then
+# stalls would hold the install forever. This covers fetching the mirror status.
+REFLECTOR_BASE_TIMEOUT = 60
+
+
+def _has_servers(path: Path) -> bool:
+    try:
+        return any(line.startswith("Server") for line in path.read_text().splitlines())
+    except OSError:
+        return False
+
+
+def _fresh_cache(cache_path: Path | None, ttl_hours: float) -> bool:
+    if cache_path is None or ttl_hours <= 0 or not _has_servers(cache_path):
+        return False
+    age_hours = (time.time() - cache_path.stat().st_mtime) / 3600
+    return age_hours < ttl_hours
+
+
+def update_mirrorlist(
+    country: str,
+    max_mirrors: int = 20,
+    probe_timeout: int = 3,
+    threads: int = 8,
+    cache_path: Path | None = None,
+    ttl_hours: float = 6,
+) -> None:
+    """Rank mirrors with bounded reflector probes, reusing a recent ranking when possible.
+
+    Args:
+        country: Country passed to reflector -c.
+        max_mirrors: Only the N most recently synced mirrors are rate-tested.
+        probe_timeout: Connection and download timeout per probe, in seconds.
+        threads: Number of mirrors probed concurrently.
+        cache_path: Saved mirrorlist shared between runs (e.g. on NFS); refreshed after ranking.
+        ttl_hours: Maximum age of cache_path before mirrors are ranked again.
+    """
+    if _fresh_cache(cache_path, ttl_hours):
+        shutil.copyfile(cache_path, MIRRORLIST)
+        print(f"Using cached mirrorlist from {cache_path}")
+        return
+
+    command = [
+        "reflector", "-c", country,
+        "--protocol", "https",
+        "--latest", str(max_mirrors),
+        "--sort", "rate",
+        "--threads", str(threads),
+        "--connection-timeout", str(probe_timeout),
+        "--download-timeout", str(probe_timeout),
+        "--save", str(MIRRORLIST),
+    ]
+    # Every batch of `threads` probes takes at most a connection and a download timeout
+    batches = -(-max_mirrors // threads)
+    returncode = try_command(command, timeout=REFLECTOR_BASE_TIMEOUT + batches * 2 * probe_timeout)
+    if returncode == 0:
+        print("Mirrorlist updated successfully")
+    else:
+        print(f" Warning: Failed to update mirrorlist with reflector (exit code {returncode})")
+        if cache_path is not None and _has_servers(cache_path):
+            shutil.copyfile(cache_path, MIRRORLIST)
+            print(f"Falling back to the expired mirrorlist cache {cache_path}")
+            return
+        print("This could affect download speeds, but the installation can continue.")
+        if not confirm("Do you want to continue with the installation?", unattended=True):
+            print("Aborted.")
+            sys.exit(0)
+        print("Continuing with installation...")
+        return
+
+    if cache_path is not None:
+        try:
+            cache_path.parent.mkdir(parents=True, exist_ok=True)
+            shutil.copyfile(MIRRORLIST, cache_path)
+        except OSError as e:
+            print(f" Warning: could not save mirrorlist cache {cache_path}: {e}")
+
+
+def rotate_mirrorlist(mirrorlist: Path = MIRRORLIST) -> None:
+    """Move the first Server entry to the end so the next attempt starts at the next-ranked mirror."""
+    try:
+        lines = mirrorlist.read_text().splitlines(keepends=True)
+    except OSError:
+        return
+    servers = [i for i, line in enumerate(lines) if line.lstrip().startswith("Server")]
+    if len(servers) < 2:
+        return
+    first = lines.pop(servers[0])
+    lines.insert(servers[-1], first)
+    mirrorlist.write_text("".join(lines))
+    # Comment lines (## Country) between entries shift with the pop, so print the entry that moved up
+    print(f"Switching to the next mirror: {lines[servers[1] - 1].split('=', 1)[1].strip()}")
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+import json
+import re
+import sys
+from dataclasses import dataclass
+from pathlib import Path
+
+LAYOUTS_PATH = Path(__file__).resolve().parent.parent / "layouts.json"
+DEFAULT_LAYOUT = "standard"
+COMPRESSION_PROPERTIES = {"zstd", "lzo", "zlib", "none"}
+
+
+@dataclass
+class Subvolume:
+    name: str
+    mountpoint: str
+    # btrfs property applied to the subvolume; overrides the filesystem-wide compress= option
+    compression: str | None = None
+    # chattr +C on the empty subvolume so every file created in it skips copy-on-write
+    nodatacow: bool = False
+    # Name of the snapper config that takes timeline snapshots of this subvolume
+    snapper: str | None = None
+
+    @property
+    def target(self) -> str:
+        return "/mnt" + ("" if self.mountpoint == "/" else self.mountpoint)
+
+
+@dataclass
+class MountLayout:
+    """Subvolumes and btrfs mount options for the target.
+
+    btrfs applies compress=, ssd, discard= and commit= to the whole filesystem, taking
+    them from the first mount, so the same option string is used for every subvolume.
+    Per-subvolume tuning is done with the compression property and nodatacow instead.
+    """
+    name: str
+    options: list[str]
+    subvolumes: list[Subvolume]
+
+    def mount_options(self, subvolume: Subvolume) -> str:
+        return ",".join(self.options + [f"subvol={subvolume.name}"])
+
+    def top_level_options(self) -> list[str]:
+        """mount arguments for the whole filesystem with the layout's options, e.g. to write into it directly."""
+        return ["-o", ",".join(self.options)] if self.options else []
+
+    def mount_order(self) -> list[Subvolume]:
+        # Parents first, so /var is mounted before /var/lib/docker is created inside it
+        return sorted(self.subvolumes, key=lambda s: (s.mountpoint != "/", s.mountpoint.count("/"), s.mountpoint))
+
+    def describe(self) -> str:
+        lines = [f"Mount layout '{self.name}': {','.join(self.options)}"]
+        for subvolume in self.mount_order():
+            tuning = []
+            if subvolume.compression:
+                tuning.append(f"compression={subvolume.compression}")
+            if subvolume.nodatacow:
+                tuning.append("nodatacow")
+            if subvolume.snapper:
+                tuning.append(f"snapper={subvolume.snapper}")
+            lines.append(f"  {subvolume.name:<12} {subvolume.mountpoint:<26} {' '.join(tuning)}")
+        return "\n".join(lines)
+
+
+def _filesystem_options(filesystem: dict, rotational: bool) -> list[str]:
+    options = list(filesystem.get("options", ["noatime", "space_cache=v2"]))
+    compress = filesystem.get("compress")
+    if compress and compress != "none":
+        options.append(f"compress={compress}")
+    ssd = filesystem.get("ssd", "auto")
+    if ssd is True or (ssd == "auto" and not rotational):
+        options.append("ssd")
+    discard = filesystem.get("discard", "auto")
+    if discard == "auto":
+        discard = None if rotational else "async"
+    if discard:
+        options.append(f"discard={discard}")
+    if filesystem.get("commit"):
+        options.append(f"commit={int(filesystem['commit'])}")
+    return options
+
+
+def load_layout(name: str, rotational: bool, path: Path = LAYOUTS_PATH) -> MountLayout:
+    """Load a named layout; "auto" ssd/discard settings follow the root drive's rotational flag."""
+    try:
+        layouts = json.loads(path.read_text()).get("layouts", {})
+    except (OSError, json.JSONDecodeError) as e:
+        print(f"Error reading mount layouts {path}: {e}")
+        sys.exit(1)
+    if name not in layouts:
+        print(f"Error: unknown mount layout '{name}'. Available layouts:")
+        for layout_name, layout in layouts.items():
+            print(f"  {layout_name}: {layout.get('description', '')}")
+        sys.exit(1)
+
+    entry = layouts[name]
+    subvolumes = [Subvolume(s["name"], s["mountpoint"], s.get("compression"), bool(s.get("nodatacow")),
+                            s.get("snapper"))
+                  for s in entry.get("subvolumes", [])]
+    names = [s.name for s in subvolumes]
+    if "@" not in names or len(set(names)) != len(names):
+        print(f"Error: mount layout '{name}' needs exactly one @ subvolume and unique names.")
+        sys.exit(1)
+    for subvolume in subvolumes:
+        if subvolume.compression is not None and subvolume.compression not in COMPRESSION_PROPERTIES:
+            print(f"Error: unsupported compression '{subvolume.compression}' for {subvolume.name}.")
+            sys.exit(1)
+        if subvolume.snapper is not None and (subvolume.nodatacow or not re.fullmatch(r"[a-z0-9_-]+", subvolume.snapper)):
+            # Snapshots re-enable copy-on-write for the next write of every file, which defeats nodatacow
+            print(f"Error: invalid snapper config '{subvolume.snapper}' for {subvolume.name}; "
+                  f"use a lowercase name on a copy-on-write subvolume.")
+            sys.exit(1)
+    configs = [s.snapper for s in subvolumes if s.snapper is not None]
+    if len(set(configs)) != len(configs):
+        print(f"Error: mount layout '{name}' uses a snapper config name twice.")
+        sys.exit(1)
+    return MountLayout(name, _filesystem_options(entry.get("filesystem", {}), rotational), subvolumes)
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+import re
+import shutil
+from pathlib import Path
+
+HOST_PACMAN_CONF = Path("/etc/pacman.conf")
+HOST_CACHE_DIR = Path("/var/cache/pacman/pkg")
+TARGET_PACMAN_CONF = Path("/mnt/etc/pacman.conf")
+TARGET_MIRRORLIST = Path("/mnt/etc/pacman.d/mirrorlist")
+
+
+def _set_option(conf_path: Path, key: str, value: str) -> None:
+    """Set `key = value` in the [options] section, replacing a commented default if present."""
+    text = conf_path.read_text()
+    line = f"{key} = {value}"
+    pattern = re.compile(rf"^#?\s*{key}\s*=.*$", flags=re.MULTILINE)
+    if pattern.search(text):
+        text = pattern.sub(line, text, count=1)
+    else:
+        text = text.replace("[options]\n", f"[options]\n{line}\n", 1)
+    conf_path.write_text(text)
+
+
+def enable_parallel_downloads(count: int, conf_path: Path = HOST_PACMAN_CONF) -> None:
+    if count > 0:
+        _set_option(conf_path, "ParallelDownloads", str(count))
+
+
+def configure_host_cache(cache_dir: Path) -> None:
+    """Point the live environment's pacman at the shared cache so pacstrap -c reuses it."""
+    cache_dir.mkdir(parents=True, exist_ok=True)
+    _set_option(HOST_PACMAN_CONF, "CacheDir", f"{cache_dir}/")
+
+
+def seed_cache(seed_dir: Path, cache_dir: Path) -> None:
+    """Copy packages from a USB stick or NFS mount into the cache, skipping ones already there."""
+    if not seed_dir.is_dir():
+        print(f"Warning: cache seed {seed_dir} is not a directory, skipping.")
+        return
+    copied = 0
+    for package in seed_dir.glob("*.pkg.tar.*"):
+        destination = cache_dir / package.name
+        if destination.exists() and destination.stat().st_size == package.stat().st_size:
+            continue
+        shutil.copy2(package, destination)
+        copied += 1
+    print(f"Seeded {copied} package file(s) from {seed_dir} into {cache_dir}")
+
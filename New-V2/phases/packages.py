@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+import json
+import sys
+from pathlib import Path
+
+from .hardware import detect_gpu_groups
+
+MANIFEST_PATH = Path(__file__).resolve().parent.parent / "packages.json"
+DEFAULT_PROFILE = "hyprland-desktop"
+
+
+def load_manifest(path: Path = MANIFEST_PATH) -> dict:
+    try:
+        return json.loads(path.read_text())
+    except (OSError, json.JSONDecodeError) as e:
+        print(f"Error reading package manifest {path}: {e}")
+        sys.exit(1)
+
+
+def get_profile(manifest: dict, name: str) -> dict:
+    profiles = manifest.get("profiles", {})
+    if name not in profiles:
+        print(f"Error: unknown profile '{name}'. Available profiles:")
+        for profile_name, profile in profiles.items():
+            print(f"  {profile_name}: {profile.get('description', '')}")
+        sys.exit(1)
+    return profiles[name]
+
+
+def profile_wants_gpu_prompt(profile: dict) -> bool:
+    return profile.get("gpu") == "prompt"
+
+
+def gpu_options(manifest: dict) -> list[str]:
+    """Values accepted as a GPU override: menu keys, gpu-* group names, auto and none."""
+    groups = [name for name in manifest.get("groups", {}) if name.startswith("gpu-")]
+    return ["auto", "none", *manifest.get("gpu_choices", {}), *groups]
+
+
+def resolve_gpu_groups(manifest: dict, profile: dict, gpu: str | None = None) -> list[str]:
+    """GPU groups for the install; gpu overrides the profile's "gpu" entry.
+
+    "auto" (or an empty menu answer) detects the driver stack from the display controllers.
+    """
+    choice = profile.get("gpu") if gpu is None else gpu
+    if choice in (None, "none", "prompt"):
+        print("No gpu driver will be installed.")
+        return []
+    if choice in ("", "auto"):
+        groups = detect_gpu_groups()
+        print(f"Detected GPU driver groups: {', '.join(groups) or 'none'}")
+        return groups
+    return [manifest.get("gpu_choices", {}).get(choice, choice)]
+
+
+def resolve_packages(manifest: dict, profile: dict, gpu: str | None = None, kernel: str | None = None) -> list[str]:
+    """Expand a profile into the complete, de-duplicated package set for one pacstrap transaction.
+
+    Args:
+        manifest: Parsed package manifest.
+        profile: Profile entry from the manifest.
+        gpu: GPU override or menu choice, see resolve_gpu_groups.
+        kernel: One of the manifest's "kernels" to install instead of the stock linux.
+    """
+    group_names = list(profile.get("groups", [])) + resolve_gpu_groups(manifest, profile, gpu)
+
+    groups = manifest.get("groups", {})
+    packages: list[str] = []
+    for group_name in group_names:
+        if group_name not in groups:
+            print(f"Error: package group '{group_name}' is not defined in the manifest.")
+            sys.exit(1)
+        packages.extend(groups[group_name])
+    if kernel is not None and kernel != "linux":
+        if kernel not in manifest.get("kernels", []):
+            print(f"Error: unknown kernel '{kernel}'; the manifest lists {', '.join(manifest.get('kernels', []))}.")
+            sys.exit(1)
+        packages = [{"linux": kernel, "linux-headers": f"{kernel}-headers"}.get(p, p) for p in packages]
+    # dict.fromkeys keeps the first occurrence order while dropping duplicates
+    return _select_kernel_modules(manifest, list(dict.fromkeys(packages)))
+
+
+def needs_dkms(packages: list[str]) -> bool:
+    return any(package.endswith("-dkms") for package in packages)
+
+
+def _select_kernel_modules(manifest: dict, packages: list[str]) -> list[str]:
+    """Prefer prebuilt modules over DKMS when the only kernel is the stock linux.
+
+    The prebuilt packages are compiled against linux only, so any other kernel keeps
+    DKMS and gets its headers added to the same transaction.
+    """
+    kernels = [package for package in packages if package in manifest.get("kernels", [])]
+    prebuilt = manifest.get("prebuilt_modules", {})
+    if kernels == ["linux"]:
+        swapped = [prebuilt.get(package, package) for package in packages]
+        if swapped != packages:
+            print("Stock kernel detected: using prebuilt kernel modules instead of DKMS.")
+        if not needs_dkms(swapped):
+            swapped = [package for package in swapped if package != "dkms"]
+        return swapped
+    if needs_dkms(packages):
+        packages += [f"{kernel}-headers" for kernel in kernels if f"{kernel}-headers" not in packages]
+    return packages
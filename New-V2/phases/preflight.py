@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+import os
+import re
+import shutil
+import sys
+import tempfile
+import time
+from dataclasses import asdict
+from dataclasses import dataclass
+from pathlib import Path
+
+from .disk_layout import GIB
+from .disk_layout import MIB
+from .disk_layout import LayoutPlan
+from .library import capture_command
+from .library import command_output
+from .library import run_command
+from .library import try_command
+from .mirrors import MIRRORLIST
+from .mirrors import rotate_mirrorlist
+from .report import REPORT
+from .staging import STAGE_DIR
+
+# Logs, the initramfs images, snapshots and later updates need room beyond the packages
+ROOT_MARGIN = 1.15
+ROOT_RESERVE = 2 * GIB
+# Copies of every data block per btrfs data profile
+PROFILE_COPIES = {"dup": 2, "raid1": 2, "raid1c3": 3, "raid1c4": 4, "raid10": 2}
+# Unpacking thousands of small files reaches a fraction of a drive's sequential rate;
+# copying a staged root in one tar stream gets close to it
+EXTRACT_EFFICIENCY = {"solid-state": 0.5, "slow": 0.2}
+STAGE_COPY_EFFICIENCY = 0.8
+# zstd zram keeps a typical root at about a third of its size; 2 leaves headroom
+ZRAM_RATIO = 2.0
+MIRROR_SAMPLE_BYTES = 32 * MIB
+MIRROR_SAMPLE_SECONDS = 8
+DISK_SAMPLE_BYTES = 256 * MIB
+# Hard limits on top of curl's own --max-time: a dead mirror or failing drive must not
+# hold the install before the wipe prompt
+PROBE_TIMEOUT = 30
+SYNC_DB_TIMEOUT = 300
+# Fixed work no estimate above covers: keyring, mkinitcpio, boot loader, ...
+FIXED_SECONDS = 120
+
+_SIZE_UNITS = {"B": 1, "KiB": 1024, "MiB": MIB, "GiB": GIB}
+
+
+@dataclass
+class Preflight:
+    packages: int
+    download_bytes: int
+    cached_bytes: int
+    installed_bytes: int
+    root_capacity_bytes: int
+    # What the install writes to the root (or stage): packages plus, without --cache-dir, their files
+    on_target_bytes: int
+    disk_read_bytes_per_s: float | None
+    stage: str
+    # Filled in by predict_install once the mirrors are ranked
+    mirror_bytes_per_s: float | None = None
+    predicted_seconds: int | None = None
+    # repo/filename of the largest package, sampled from the ranked mirror
+    sample_package: str | None = None
+
+
+def _parse_size(text: str) -> int:
+    value, unit = text.split()
+    return int(float(value) * _SIZE_UNITS[unit])
+
+
+def _resolve(packages: list[str], dbpath: str) -> list[tuple[str, int, str]]:
+    """(repo/name, download size, URL) of every package the install pulls in, as an empty root sees it."""
+    output = command_output(["pacman", "-Sp", "--noconfirm", "--dbpath", dbpath, "--logfile", "/dev/null",
+                             "--print-format", "%r/%n %s %l", *packages])
+    resolved = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1].isdigit():
+            resolved.append((fields[0], int(fields[1]), fields[2]))
+    return resolved
+
+
+def _installed_size(names: list[str], dbpath: str) -> int:
+    output = command_output(["pacman", "-Si", "--dbpath", dbpath, *names])
+    return sum(_parse_size(match) for match in re.findall(r"^Installed Size\s*:\s*(.+)$", output, re.MULTILINE))
+
+
+def measure_mirror(url: str) -> float | None:
+    """Bytes per second of a ranged download of one package from the first mirror."""
+    returncode, output = capture_command(["curl", "-fsS", "-o", "/dev/null", "--max-time", str(MIRROR_SAMPLE_SECONDS),
+                                          "-r", f"0-{MIRROR_SAMPLE_BYTES - 1}", "-w", "%{size_download} %{time_total}",
+                                          url], timeout=PROBE_TIMEOUT)
+    try:
+        size, seconds = (float(value) for value in output.split())
+    except ValueError:
+        return None
+    # curl exits 28 when --max-time cut the sample short; what it got is still a measurement
+    if returncode not in {0, 28} or size == 0 or seconds == 0:
+        return None
+    return size / seconds
+
+
+def measure_disk(device: str) -> float | None:
+    """Sequential O_DIRECT read rate of the target drive.
+
+    Reading is the only test that leaves the drive untouched; writes on most drives
+    are no faster, so it bounds the install from below.
+    """
+    start = time.monotonic()
+    returncode = try_command(["dd", f"if={device}", "of=/dev/null", "bs=4M", f"count={DISK_SAMPLE_BYTES // (4 * MIB)}",
+                              "iflag=direct", "status=none"], timeout=PROBE_TIMEOUT)
+    seconds = time.monotonic() - start
+    return DISK_SAMPLE_BYTES / seconds if returncode == 0 and seconds > 0 else None
+
+
+def root_capacity(plan: LayoutPlan) -> int:
+    """Usable bytes of the btrfs root across all its devices, after data redundancy."""
+    raw = 0
+    for disk in plan.all_disks():
+        root = disk.partition("root")
+        raw += root.size if root.size is not None else disk.disk.size_bytes - root.start
+    return raw // PROFILE_COPIES.get(plan.data_profile or "single", 1)
+
+
+def _cached_bytes(resolved: list[tuple[str, int, str]], cache_dir: Path) -> int:
+    return sum(size for _, size, url in resolved if (cache_dir / url.rsplit("/", 1)[-1]).exists())
+
+
+def _stage_fits(stage: str, needed: int, ram: int) -> bool:
+    if stage == "tmpfs":
+        return needed <= ram * 3 // 4
+    if stage == "zram":
+        return needed / ZRAM_RATIO <= ram * 3 // 4
+    return True
+
+
+def run_preflight(packages: list[str], plan: LayoutPlan, stage: str, stage_requested: str,
+                  cache_dir: Path | None, host_cache: Path, swap_bytes: int, ram: int, retries: int = 0) -> Preflight:
+    """Check that the install fits before any disk is touched.
+
+    Sizes come from freshly synced databases in a scratch dbpath, so the host's own
+    pacman state is left alone and every dependency counts as not yet installed.
+    The returned stage is the staging mode to use: an automatically chosen stage that
+    does not fit in RAM falls back to "off"; an explicit one stops the install. The
+    mirror rate and install time are measured later by predict_install. retries is
+    --retries: the sync runs against the ISO's unranked mirrorlist.
+    """
+    errors = []
+    dbpath = tempfile.mkdtemp(prefix="installer-preflight-")
+    try:
+        run_command(["pacman", "-Sy", "--dbpath", dbpath, "--logfile", "/dev/null"], retries=retries,
+                    before_retry=rotate_mirrorlist, timeout=SYNC_DB_TIMEOUT)
+        resolved = _resolve(packages, dbpath)
+        installed = _installed_size([name for name, _, _ in resolved], dbpath)
+    finally:
+        shutil.rmtree(dbpath, ignore_errors=True)
+    download = sum(size for _, size, _ in resolved)
+    cached = _cached_bytes(resolved, cache_dir or host_cache)
+
+    # Without a shared cache pacstrap keeps every package file in the target's own cache
+    on_target = installed + (download if cache_dir is None else 0)
+    capacity = root_capacity(plan)
+    needed = int(on_target * ROOT_MARGIN) + ROOT_RESERVE + swap_bytes
+    if needed > capacity:
+        errors.append(f"the root filesystem holds {capacity / GIB:.1f} GiB, the install needs about {needed / GIB:.1f} GiB "
+                      f"({installed / GIB:.1f} GiB of packages)")
+    if cache_dir is not None:
+        free = shutil.disk_usage(cache_dir).free
+        if download - cached > free:
+            errors.append(f"--cache-dir {cache_dir} has {free / GIB:.1f} GiB free, "
+                          f"{(download - cached) / GIB:.1f} GiB of packages must be downloaded into it")
+
+    if not _stage_fits(stage, on_target, ram):
+        if stage_requested == "auto":
+            print(f"The install ({on_target / GIB:.1f} GiB) does not fit a {stage} stage in RAM; installing to disk directly.")
+            stage = "off"
+        else:
+            errors.append(f"--stage {stage}: {on_target / GIB:.1f} GiB does not fit into {STAGE_DIR} "
+                          f"with {ram / GIB:.1f} GiB of RAM")
+
+    largest = max(resolved, key=lambda package: package[1], default=None)
+    disk = measure_disk(plan.disk.path)
+    # The URL pacman printed points at the ISO's unranked mirrorlist; only repo and file are kept
+    sample = f"{largest[0].split('/', 1)[0]}/{largest[2].rsplit('/', 1)[-1]}" if largest is not None else None
+    result = Preflight(len(resolved), download, cached, installed, capacity, on_target, disk, stage, sample_package=sample)
+    _store(result)
+    print(describe_preflight(result))
+
+    if errors:
+        print("Error: the install cannot succeed, nothing was changed:")
+        for error in errors:
+            print(f"  {error}")
+        sys.exit(1)
+    return result
+
+
+def _store(result: Preflight) -> None:
+    with REPORT.lock:
+        REPORT.extra["preflight"] = asdict(result)
+
+
+def _first_server(mirrorlist: Path = MIRRORLIST) -> str | None:
+    try:
+        for line in mirrorlist.read_text().splitlines():
+            key, _, value = line.partition("=")
+            if key.strip() == "Server" and value.strip():
+                return value.strip()
+    except OSError:
+        pass
+    return None
+
+
+def predict_install(result: Preflight, plan: LayoutPlan) -> None:
+    """Sample the top mirror of the ranked list and predict the install time from it.
+
+    Runs as a task after the mirrors are ranked, because the mirror pacstrap ends
+    up using is unknown before that. By then the disk is wiped, so the prediction
+    is advisory: a slow mirror is reported, never fatal.
+    """
+    server = _first_server()
+    mirror = None
+    if server is not None and result.sample_package is not None:
+        repo, filename = result.sample_package.split("/", 1)
+        base = server.replace("$repo", repo).replace("$arch", os.uname().machine)
+        mirror = measure_mirror(f"{base.rstrip('/')}/{filename}")
+    if mirror is None:
+        print("Warning: could not measure the ranked mirror's throughput; the prediction leaves downloads out.")
+
+    on_target = result.on_target_bytes
+    seconds = FIXED_SECONDS + ((result.download_bytes - result.cached_bytes) / mirror if mirror else 0)
+    disk = result.disk_read_bytes_per_s
+    if disk:
+        if result.stage != "off":
+            seconds += on_target / (disk * STAGE_COPY_EFFICIENCY)
+        else:
+            slow = plan.disk.rotational or plan.disk.removable
+            seconds += on_target / (disk * EXTRACT_EFFICIENCY["slow" if slow else "solid-state"])
+    result.mirror_bytes_per_s, result.predicted_seconds = mirror, int(seconds)
+    _store(result)
+    print(f"Pre-flight: ranked mirror {_rate(mirror)}; predicted install time about "
+          f"{max(1, round(seconds / 60))} min")
+
+
+def _rate(value: float | None) -> str:
+    return f"{value / MIB:.1f} MiB/s" if value else "unknown"
+
+
+def describe_preflight(result: Preflight) -> str:
+    return "\n".join([
+        f"Pre-flight: {result.packages} packages, {result.download_bytes / GIB:.2f} GiB to download "
+        f"({result.cached_bytes / GIB:.2f} GiB cached), {result.installed_bytes / GIB:.2f} GiB installed, "
+        f"{result.root_capacity_bytes / GIB:.1f} GiB root",
+        f"  disk read {_rate(result.disk_read_bytes_per_s)}, stage {result.stage}; "
+        f"the mirror is sampled once the mirrorlist is ranked",
+    ])
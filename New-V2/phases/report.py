@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+import json
+import threading
+import time
+from contextlib import contextmanager
+from dataclasses import asdict
+from dataclasses import dataclass
+from dataclasses import field
+from datetime import datetime
+from datetime import timezone
+from pathlib import Path
+from typing import Callable
+
+DEFAULT_REPORT_PATH = Path("/root/install-report.json")
+TARGET_REPORT_PATH = Path("/mnt/var/log/installer/report.json")
+
+
+@dataclass
+class CommandRecord:
+    phase: str | None
+    command: list[str]
+    started: float
+    duration: float = 0.0
+    exit_code: int = 0
+    # Host-wide receive counter delta, so concurrent commands share their traffic
+    rx_bytes: int = 0
+    # From os.wait4: the command and every descendant it waited for. Linux carries the
+    # forking installer's RSS over into max_rss_bytes, so small commands show about that
+    cpu_seconds: float = 0.0
+    max_rss_bytes: int = 0
+    read_bytes: int = 0
+    write_bytes: int = 0
+    timed_out: bool = False
+
+
+@dataclass
+class PhaseRecord:
+    name: str
+    started: float
+    duration: float = 0.0
+    ok: bool = True
+
+
+@dataclass
+class InstallReport:
+    started_at: str = field(default_factory=lambda: datetime.now(timezone.utc).isoformat(timespec="seconds"))
+    origin: float = field(default_factory=time.monotonic)
+    phases: list[PhaseRecord] = field(default_factory=list)
+    commands: list[CommandRecord] = field(default_factory=list)
+    extra: dict = field(default_factory=dict)
+    lock: threading.Lock = field(default_factory=threading.Lock)
+
+    def elapsed(self) -> float:
+        return time.monotonic() - self.origin
+
+
+REPORT = InstallReport()
+_current = threading.local()
+_listeners: list[Callable[[dict], None]] = []
+
+
+def add_listener(callback: Callable[[dict], None]) -> None:
+    """Call callback with a dict for every phase start/end and finished command, e.g. to stream progress."""
+    _listeners.append(callback)
+
+
+def _notify(event: dict) -> None:
+    for callback in list(_listeners):
+        try:
+            callback(event)
+        except Exception as e:
+            # Progress reporting must never fail the install
+            print(f"Warning: install event listener failed: {e}")
+
+
+def current_phase() -> str | None:
+    return getattr(_current, "phase", None)
+
+
+def rx_bytes() -> int:
+    """Bytes received on all non-loopback interfaces since boot."""
+    total = 0
+    try:
+        for line in Path("/proc/net/dev").read_text().splitlines()[2:]:
+            name, data = line.split(":", 1)
+            if name.strip() != "lo":
+                total += int(data.split()[0])
+    except (OSError, ValueError, IndexError):
+        pass
+    return total
+
+
+@contextmanager
+def track_command(command: list[str]):
+    """Time a command; the caller sets exit_code on the yielded record when it fails."""
+    record = CommandRecord(phase=current_phase(), command=list(command), started=round(REPORT.elapsed(), 3))
+    rx_start = rx_bytes()
+    try:
+        yield record
+    except BaseException:
+        if record.exit_code == 0:
+            record.exit_code = -1
+        raise
+    finally:
+        record.duration = round(REPORT.elapsed() - record.started, 3)
+        record.rx_bytes = max(0, rx_bytes() - rx_start)
+        with REPORT.lock:
+            REPORT.commands.append(record)
+        _notify({"event": "command", **asdict(record)})
+
+
+@contextmanager
+def track_phase(name: str):
+    """Time a phase and attribute commands run in this thread to it."""
+    record = PhaseRecord(name=name, started=round(REPORT.elapsed(), 3))
+    previous = current_phase()
+    _current.phase = name
+    _notify({"event": "phase_start", "phase": name, "started": record.started})
+    try:
+        yield record
+    except BaseException:
+        record.ok = False
+        raise
+    finally:
+        _current.phase = previous
+        record.duration = round(REPORT.elapsed() - record.started, 3)
+        with REPORT.lock:
+            REPORT.phases.append(record)
+        _notify({"event": "phase_end", "phase": name, "duration": record.duration, "ok": record.ok})
+
+
+def report_dict(ok: bool) -> dict:
+    with REPORT.lock:
+        return {
+            "started_at": REPORT.started_at,
+            "duration": round(REPORT.elapsed(), 3),
+            "ok": ok,
+            "phases": [asdict(phase) for phase in REPORT.phases],
+            "commands": [asdict(command) for command in REPORT.commands],
+            **REPORT.extra,
+        }
+
+
+def write_report(path: Path, ok: bool) -> None:
+    """Write the JSON report to path and, when the target is mounted, into its /var/log."""
+    text = json.dumps(report_dict(ok), indent=2)
+    destinations = [path]
+    if TARGET_REPORT_PATH.parent.parent.is_dir():
+        destinations.append(TARGET_REPORT_PATH)
+    for destination in destinations:
+        try:
+            destination.parent.mkdir(parents=True, exist_ok=True)
+            destination.write_text(text)
+        except OSError as e:
+            print(f"Warning: could not write install report {destination}: {e}")
+    print(f"Install report written to {', '.join(str(d) for d in destinations)}")
+
+
+def _format_bytes(count: int) -> str:
+    for unit in ["B", "KiB", "MiB", "GiB"]:
+        if count < 1024 or unit == "GiB":
+            return f"{count:.0f} {unit}" if unit == "B" else f"{count:.1f} {unit}"
+        count /= 1024
+    return str(count)
+
+
+def print_summary(slowest: int = 5) -> None:
+    with REPORT.lock:
+        phases = list(REPORT.phases)
+        commands = list(REPORT.commands)
+    print("\nPhase                     Start     Time  Status   Commands  Downloaded")
+    print("-" * 74)
+    for phase in sorted(phases, key=lambda p: p.started):
+        own = [c for c in commands if c.phase == phase.name]
+        status = "ok" if phase.ok else "FAILED"
+        downloaded = _format_bytes(sum(c.rx_bytes for c in own))
+        print(f"{phase.name:<24} {phase.started:6.1f}s {phase.duration:7.1f}s  {status:<8} {len(own):>8}  {downloaded:>10}")
+    print("-" * 74)
+    print(f"Total wall time: {REPORT.elapsed():.1f}s")
+    if commands:
+        print("\nSlowest commands:")
+        for command in sorted(commands, key=lambda c: c.duration, reverse=True)[:slowest]:
+            joined = " ".join(command.command)
+            if len(joined) > 44:
+                joined = joined[:41] + "..."
+            print(f"{command.duration:7.1f}s  exit {command.exit_code:<3}  cpu {command.cpu_seconds:6.1f}s  "
+                  f"rss {_format_bytes(command.max_rss_bytes):>9}  {joined}")
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+import shutil
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+from .chroot import ChrootSession
+from .library import command_output
+from .library import run_command
+from .mirrors import MIRRORLIST
+from .mount_layout import MountLayout
+from .report import REPORT
+
+# The subvolumes a reprovision changes: @var is included because it holds the pacman
+# database, which has to roll back together with the files in @
+ROLLBACK_SUBVOLUMES = ["@", "@var"]
+# Read-only copies sit next to the originals at the top level, outside snapper's numbered snapshots
+ROLLBACK_SUFFIX = ".pre-reprovision-"
+TARGET_CACHE_DIR = Path("/var/cache/pacman/pkg")
+
+# Every wanted package (group names expanded) is marked explicit; any other explicit
+# package becomes a dependency, so the orphan removal takes it and what only it needed
+PRUNE_PACKAGES = """
+wanted=$(printf '%s\\n' {packages} $(pacman -Sgq {packages} 2>/dev/null || true) | sort -u)
+pacman -D --asexplicit $(pacman -Qq $wanted 2>/dev/null || true) >/dev/null
+extras=$(pacman -Qqe | sort | comm -23 - <(printf '%s\\n' "$wanted"))
+if [ -n "$extras" ]; then
+    echo "Not in the profile, removing:" $extras
+    pacman -D --asdeps $extras >/dev/null
+fi
+orphans=$(pacman -Qdtq || true)
+[ -z "$orphans" ] || pacman -Rns --noconfirm $orphans
+"""
+
+
+def _top_level_subvolumes() -> list[str]:
+    # "ID 256 gen 31 top level 5 path @": nested subvolumes such as /home/.snapshots are skipped
+    names = []
+    for line in command_output(["btrfs", "subvolume", "list", "/mnt"]).splitlines():
+        fields = line.split()
+        if len(fields) >= 9 and fields[6] == "5":
+            names.append(fields[8])
+    return names
+
+
+def check_reprovision(root: str, layout: MountLayout) -> list[str]:
+    """Make sure root holds an earlier install with this layout; returns the subvolumes still to create.
+
+    Runs before anything is changed, so a mismatch (other --swap or --efi-size, other
+    drive) stops here instead of mounting the wrong partition.
+    """
+    if command_output(["blkid", "-s", "TYPE", "-o", "value", root]) != "btrfs":
+        print(f"Error: {root} is not a btrfs filesystem; reprovisioning needs the partition layout of the "
+              f"original install (same drives, --swap, --swap-size and --efi-size).")
+        sys.exit(1)
+    run_command(["mount", "-o", "subvolid=5", root, "/mnt"])
+    try:
+        existing = _top_level_subvolumes()
+    finally:
+        subprocess.run(["umount", "/mnt"], check=False)
+    if "@" not in existing:
+        print(f"Error: {root} has no @ subvolume, so there is no install to reprovision.")
+        sys.exit(1)
+    return [s.name for s in layout.subvolumes if s.name not in existing]
+
+
+def snapshot_root(root: str) -> list[str]:
+    """Keep the current @ (and @var) as read-only rollback points before touching them."""
+    stamp = time.strftime("%Y%m%d-%H%M%S")
+    run_command(["mount", "-o", "subvolid=5", root, "/mnt"])
+    try:
+        snapshots = []
+        for name in ROLLBACK_SUBVOLUMES:
+            if Path(f"/mnt/{name}").is_dir():
+                snapshot = f"{name}{ROLLBACK_SUFFIX}{stamp}"
+                run_command(["btrfs", "subvolume", "snapshot", "-r", f"/mnt/{name}", f"/mnt/{snapshot}"])
+                snapshots.append(snapshot)
+    finally:
+        subprocess.run(["umount", "/mnt"], check=False)
+    with REPORT.lock:
+        REPORT.extra["reprovision"] = {"rollback_snapshots": snapshots}
+    print(f"Rollback point(s) at the top level of {root}: {', '.join(snapshots)}")
+    return snapshots
+
+
+def sync_packages(packages: list[str], cache_dir: Path | None = None) -> None:
+    """Bring the installed package set to exactly the profile's: upgrade, add what is missing, drop the rest.
+
+    With a shared --cache-dir, it is bind-mounted over the target's package cache for
+    the upgrade, so a fleet downloads every package once.
+    """
+    # The host's mirrorlist was just ranked; the target's may be months old
+    shutil.copyfile(MIRRORLIST, Path("/mnt") / MIRRORLIST.relative_to("/"))
+    target_cache = Path("/mnt") / TARGET_CACHE_DIR.relative_to("/")
+    if cache_dir is not None:
+        target_cache.mkdir(parents=True, exist_ok=True)
+        run_command(["mount", "--bind", str(cache_dir), str(target_cache)])
+    joined = " ".join(packages)
+    try:
+        with ChrootSession() as chroot:
+            # Packages signed by keys newer than the target's keyring would fail the upgrade
+            chroot.run("keyring", "pacman -Sy --needed --noconfirm archlinux-keyring")
+            chroot.run("upgrade", f"pacman -Syu --needed --noconfirm {joined}")
+            chroot.run("prune", PRUNE_PACKAGES.format(packages=joined))
+    finally:
+        if cache_dir is not None:
+            subprocess.run(["umount", str(target_cache)], check=False)
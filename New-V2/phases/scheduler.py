@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+import sys
+from concurrent.futures import FIRST_COMPLETED
+from concurrent.futures import Future
+from concurrent.futures import ThreadPoolExecutor
+from concurrent.futures import wait
+from dataclasses import dataclass
+from dataclasses import field
+from typing import Callable
+
+from .report import track_phase
+
+
+@dataclass
+class Task:
+    """A unit of install work that may start once every task named in `after` has finished.
+
+    Tasks with checkpoint=False only change the live host (mirrorlist, keyring, ...), so
+    they are never recorded as completed and rerun on resume when something still needs them.
+    """
+    name: str
+    action: Callable[[], None]
+    after: list[str] = field(default_factory=list)
+    checkpoint: bool = True
+
+
+def _check_graph(tasks: list[Task]) -> None:
+    names = [task.name for task in tasks]
+    if len(names) != len(set(names)):
+        print(f"Error: duplicate task names in {names}")
+        sys.exit(1)
+    by_name = {task.name: task for task in tasks}
+    for task in tasks:
+        for dependency in task.after:
+            if dependency not in by_name:
+                print(f"Error: task '{task.name}' depends on unknown task '{dependency}'")
+                sys.exit(1)
+
+    # Depth-first walk to reject cycles before anything runs
+    state: dict[str, str] = {}
+
+    def visit(name: str) -> None:
+        if state.get(name) == "done":
+            return
+        if state.get(name) == "visiting":
+            print(f"Error: dependency cycle through task '{name}'")
+            sys.exit(1)
+        state[name] = "visiting"
+        for dependency in by_name[name].after:
+            visit(dependency)
+        state[name] = "done"
+
+    for name in names:
+        visit(name)
+
+
+def _tasks_to_skip(tasks: list[Task], completed: set[str]) -> set[str]:
+    """Completed tasks, plus host-only tasks whose dependents are all skipped too."""
+    dependents: dict[str, list[str]] = {task.name: [] for task in tasks}
+    for task in tasks:
+        for dependency in task.after:
+            dependents[dependency].append(task.name)
+    memo: dict[str, bool] = {}
+
+    def will_run(name: str) -> bool:
+        if name not in memo:
+            if name in completed:
+                memo[name] = False
+            else:
+                memo[name] = not dependents[name] or any(will_run(d) for d in dependents[name])
+        return memo[name]
+
+    return {task.name for task in tasks if not will_run(task.name)}
+
+
+def run_tasks(
+    tasks: list[Task],
+    max_workers: int = 4,
+    completed: set[str] | None = None,
+    on_done: Callable[[str], None] | None = None,
+) -> None:
+    """Run tasks concurrently, each as soon as its dependencies are done.
+
+    The first failure stops new tasks from being started; tasks already running
+    are allowed to finish and the failure (including SystemExit from
+    run_command) is then re-raised in the caller's thread.
+
+    Args:
+        tasks: The task graph.
+        max_workers: Maximum number of tasks running at once.
+        completed: Task names finished by an earlier run; they and any host-only
+            tasks nothing else needs any more are skipped.
+        on_done: Called with the name of each finished task that has checkpoint=True.
+    """
+    _check_graph(tasks)
+    skipped = _tasks_to_skip(tasks, completed or set())
+    pending = {task.name: task for task in tasks if task.name not in skipped}
+    finished: set[str] = set(skipped)
+    running: dict[Future, Task] = {}
+    failure: BaseException | None = None
+
+    def timed(task: Task) -> None:
+        with track_phase(task.name):
+            task.action()
+
+    def start(task: Task) -> None:
+        print(f"==> {task.name}")
+        running[executor.submit(timed, task)] = task
+
+    with ThreadPoolExecutor(max_workers=max_workers) as executor:
+        while pending or running:
+            if failure is None:
+                for task in [t for t in pending.values() if all(d in finished for d in t.after)]:
+                    del pending[task.name]
+                    start(task)
+            if not running:
+                break
+            done, _ = wait(running, return_when=FIRST_COMPLETED)
+            for future in done:
+                task = running.pop(future)
+                error = future.exception()
+                if error is None:
+                    finished.add(task.name)
+                    print(f"<== {task.name} done")
+                    if on_done is not None and task.checkpoint:
+                        on_done(task.name)
+                elif failure is None:
+                    print(f"Task '{task.name}' failed")
+                    failure = error
+
+    if failure is not None:
+        raise failure
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+import re
+from pathlib import Path
+
+from .library import run_command
+from .library import write_file
+from .mount_layout import MountLayout
+from .mount_layout import Subvolume
+
+SNAPPER_TEMPLATE = Path("/mnt/usr/share/snapper/config-templates/default")
+SNAPPER_CONFIGS = Path("/mnt/etc/snapper/configs")
+SNAPPER_SYSCONFIG = Path("/mnt/etc/conf.d/snapper")
+
+# Every snapshot pins old extents, and each one makes balance, scrub and
+# grub-mkconfig (one menu entry per snapshot) slower; keep about a day of
+# hourly snapshots and a week of dailies instead of the template's 10 years
+SNAPPER_SETTINGS = {
+    "ALLOW_GROUPS": "wheel",
+    # Empty: no qgroup per snapshot. Quotas make every snapshot deletion and balance
+    # recompute extent accounting, the main cause of multi-second stalls
+    "QGROUP": "",
+    "TIMELINE_CREATE": "yes",
+    "TIMELINE_CLEANUP": "yes",
+    "TIMELINE_MIN_AGE": "1800",
+    "TIMELINE_LIMIT_HOURLY": "6",
+    "TIMELINE_LIMIT_DAILY": "7",
+    "TIMELINE_LIMIT_WEEKLY": "0",
+    "TIMELINE_LIMIT_MONTHLY": "0",
+    "TIMELINE_LIMIT_YEARLY": "0",
+    "NUMBER_CLEANUP": "yes",
+    "NUMBER_MIN_AGE": "1800",
+    "NUMBER_LIMIT": "10",
+    "NUMBER_LIMIT_IMPORTANT": "5",
+}
+
+# btrfs-progs ships btrfs-scrub@.timer (monthly); make sure it only uses idle I/O and CPU
+SCRUB_TIMER = "btrfs-scrub@-.timer"
+SCRUB_OVERRIDE = """[Service]
+Nice=19
+CPUSchedulingPolicy=idle
+IOSchedulingClass=idle
+"""
+
+# Filtered balance: only rewrites chunks that are at most half full, which returns
+# unused space to the allocator in minutes instead of rewriting the whole filesystem
+BALANCE_SERVICE = """[Unit]
+Description=Compact partly used btrfs chunks on /
+ConditionACPower=true
+
+[Service]
+Type=oneshot
+ExecStart=/usr/bin/btrfs balance start -dusage=50 -musage=50 /
+Nice=19
+CPUSchedulingPolicy=idle
+IOSchedulingClass=idle
+KillSignal=SIGINT
+"""
+
+BALANCE_TIMER = """[Unit]
+Description=Monthly filtered btrfs balance on /
+
+[Timer]
+OnCalendar=monthly
+RandomizedDelaySec=1d
+Persistent=true
+
+[Install]
+WantedBy=timers.target
+"""
+
+
+def snapper_config(template: str, subvolume: Subvolume) -> str:
+    """The stock snapper template with bounded retention for one subvolume."""
+    settings = {"SUBVOLUME": subvolume.mountpoint, **SNAPPER_SETTINGS}
+    for key, value in settings.items():
+        line = f'{key}="{value}"'
+        template, found = re.subn(rf"^{key}=.*$", line, template, flags=re.MULTILINE)
+        if not found:
+            template += line + "\n"
+    return template
+
+
+def _snapshot_dir(subvolume: Subvolume) -> str:
+    return ("" if subvolume.mountpoint == "/" else subvolume.mountpoint) + "/.snapshots"
+
+
+def configure_snapper(layout: MountLayout) -> list[str]:
+    """Write a snapper config for every layout subvolume with a "snapper" name.
+
+    Written directly instead of `snapper create-config`, which insists on creating
+    .snapshots itself and fails when @snapshots is already mounted there.
+    Returns the config names, empty when snapper is not installed.
+    """
+    subvolumes = [s for s in layout.subvolumes if s.snapper is not None]
+    if not subvolumes:
+        return []
+    if not SNAPPER_TEMPLATE.exists():
+        print("Warning: snapper is not installed on the target; no snapshot configs were written.")
+        return []
+    template = SNAPPER_TEMPLATE.read_text()
+    mounted = {s.mountpoint for s in layout.subvolumes}
+    for subvolume in subvolumes:
+        snapshots = _snapshot_dir(subvolume)
+        target = Path("/mnt" + snapshots)
+        # Without a dedicated subvolume (like @snapshots for /), snapper needs a nested one
+        if snapshots not in mounted and not target.exists():
+            run_command(["btrfs", "subvolume", "create", str(target)])
+        # Snapshots of /home hold every user's files; only root and wheel may browse them
+        target.chmod(0o750)
+        write_file(SNAPPER_CONFIGS / subvolume.snapper, snapper_config(template, subvolume), mode=0o640)
+    names = [s.snapper for s in subvolumes]
+    sysconfig = SNAPPER_SYSCONFIG.read_text() if SNAPPER_SYSCONFIG.exists() else ""
+    line = f'SNAPPER_CONFIGS="{" ".join(names)}"'
+    sysconfig, found = re.subn(r"^SNAPPER_CONFIGS=.*$", line, sysconfig, flags=re.MULTILINE)
+    write_file(SNAPPER_SYSCONFIG, sysconfig if found else sysconfig + line + "\n", mode=0o644)
+    return names
+
+
+def configure_maintenance() -> None:
+    """Monthly scrub and filtered balance of / at idle I/O priority."""
+    write_file(Path("/mnt/etc/systemd/system/btrfs-scrub@.service.d/idle.conf"), SCRUB_OVERRIDE, mode=0o644)
+    write_file(Path("/mnt/etc/systemd/system/btrfs-balance.service"), BALANCE_SERVICE, mode=0o644)
+    write_file(Path("/mnt/etc/systemd/system/btrfs-balance.timer"), BALANCE_TIMER, mode=0o644)
+    run_command(["systemctl", "--root=/mnt", "enable", SCRUB_TIMER, "btrfs-balance.timer"])
+
+
+def configure_snapshots(layout: MountLayout) -> None:
+    # A received image or an earlier manual setup may have left quotas on
+    run_command(["btrfs", "quota", "disable", "/mnt"])
+    names = configure_snapper(layout)
+    configure_maintenance()
+    if names:
+        print(f"Snapper configs: {', '.join(names)} (hourly x{SNAPPER_SETTINGS['TIMELINE_LIMIT_HOURLY']}, "
+              f"daily x{SNAPPER_SETTINGS['TIMELINE_LIMIT_DAILY']}, quotas off)")
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+import subprocess
+import sys
+from pathlib import Path
+
+from .disk_layout import GIB
+from .disk_layout import DiskInfo
+from .library import command_output
+from .library import pipeline
+from .library import run_command
+from .library import try_command
+
+STAGE_MODES = ["off", "auto", "tmpfs", "zram"]
+STAGE_DIR = "/run/installer-stage"
+# A desktop profile unpacks to roughly 6-8 GiB; tmpfs holds it uncompressed, a zstd
+# zram device in about a third of that
+TMPFS_MIN_RAM = 12 * GIB
+ZRAM_MIN_RAM = 6 * GIB
+# tar record size for the copy: large sequential writes instead of one per small file
+TAR_BLOCKING_FACTOR = "2048"  # x 512 bytes = 1 MiB
+TAR_FLAGS = ["--numeric-owner", "--xattrs", "--xattrs-include=*", "--acls", "-b", TAR_BLOCKING_FACTOR]
+
+
+def stage_mode(mode: str, disk: DiskInfo, ram: int) -> str:
+    """Resolve --stage: "auto" stages only on slow media (rotational, USB or removable) with enough RAM."""
+    if mode == "auto":
+        if not (disk.rotational or disk.removable):
+            return "off"
+        if ram >= TMPFS_MIN_RAM:
+            return "tmpfs"
+        return "zram" if ram >= ZRAM_MIN_RAM else "off"
+    minimum = {"tmpfs": TMPFS_MIN_RAM, "zram": ZRAM_MIN_RAM}.get(mode)
+    if minimum is not None and ram < minimum:
+        print(f"Error: --stage {mode} needs at least {minimum // GIB} GiB of RAM, this machine has {ram / GIB:.1f} GiB.")
+        sys.exit(1)
+    return mode
+
+
+def mount_stage(mode: str, ram: int) -> None:
+    subprocess.run(["umount", STAGE_DIR], stderr=subprocess.DEVNULL, check=False)
+    run_command(["mkdir", "-p", STAGE_DIR])
+    if mode == "tmpfs":
+        run_command(["mount", "-t", "tmpfs", "-o", "size=75%,mode=0755", "tmpfs", STAGE_DIR])
+        return
+    # The device size is only an upper bound; mem_limit caps the RAM the compressed data may use
+    device = command_output(["zramctl", "--find", "--size", f"{ram // GIB * 2}G", "--algorithm", "zstd"])
+    Path(f"/sys/block/{Path(device).name}/mem_limit").write_text(f"{ram * 3 // 4}\n")
+    # No journal: the stage is thrown away after the copy
+    run_command(["mkfs.ext4", "-q", "-O", "^has_journal", "-m", "0", device])
+    run_command(["mount", device, STAGE_DIR])
+
+
+def _staged_device() -> str | None:
+    for line in Path("/proc/self/mounts").read_text().splitlines():
+        fields = line.split()
+        if fields[1] == STAGE_DIR:
+            return fields[0]
+    return None
+
+
+def release_stage() -> None:
+    device = _staged_device()
+    if device is None:
+        return
+    run_command(["umount", STAGE_DIR])
+    if device.startswith("/dev/zram"):
+        run_command(["zramctl", "--reset", device])
+
+
+def copy_stage() -> None:
+    """Move the staged root onto the mounted target layout in one tar stream.
+
+    Each file lands in whichever subvolume is mounted at its path. /boot goes to the
+    FAT EFI partition without owners or modes, which FAT cannot store.
+    """
+    pack = ["tar", "-cf", "-", "-C", STAGE_DIR, "--one-file-system", *TAR_FLAGS,
+            "--exclude=./boot", "--exclude=./lost+found", "."]
+    unpack = ["tar", "-xpf", "-", "-C", "/mnt", *TAR_FLAGS]
+    if try_command(pipeline([pack, unpack])) != 0:
+        print("Copying the staged root failed.")
+        sys.exit(1)
+    run_command(["cp", "-rT", "--no-preserve=mode,ownership", f"{STAGE_DIR}/boot", "/mnt/boot"])
+    # Flush here so the write-back shows up in this step's timing, not in genfstab's
+    run_command(["sync", "-f", "/mnt"])
+    release_stage()
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+import json
+import os
+import sys
+import threading
+from pathlib import Path
+
+STATE_PATH = Path("/mnt/var/lib/installer/state.json")
+STATE_VERSION = 1
+
+
+class Checkpoint:
+    """Completed task names for one install, persisted on the target so --resume can skip them.
+
+    Nothing is written until the subvolume that holds STATE_PATH is mounted: @var at
+    /mnt/var when the layout has one, otherwise the root at /mnt. Tasks that finish
+    earlier are kept in memory and flushed with the first write.
+    """
+
+    def __init__(self, mode: str, disk: str, completed: set[str] | None = None, state_mount: str = "/mnt"):
+        self.mode = mode
+        self.disk = disk
+        self.completed = set(completed or [])
+        self.state_mount = state_mount
+        self.lock = threading.Lock()
+
+    def mark(self, name: str) -> None:
+        with self.lock:
+            self.completed.add(name)
+            if os.path.ismount(self.state_mount):
+                self._write()
+
+    def _write(self) -> None:
+        state = {"version": STATE_VERSION, "mode": self.mode, "disk": self.disk,
+                 "completed": sorted(self.completed)}
+        try:
+            STATE_PATH.parent.mkdir(parents=True, exist_ok=True)
+            temp_path = STATE_PATH.with_suffix(".tmp")
+            temp_path.write_text(json.dumps(state, indent=2))
+            temp_path.replace(STATE_PATH)
+        except OSError as e:
+            print(f"Warning: could not write install state {STATE_PATH}: {e}")
+
+
+def state_mount(targets: list[str]) -> str:
+    """The deepest of the layout's mount targets (e.g. /mnt, /mnt/var) that STATE_PATH lives under.
+
+    Writing before that one is mounted would leave the state underneath it, hidden.
+    """
+    holders = [target for target in targets if STATE_PATH.is_relative_to(target)]
+    return max(holders, key=len, default="/mnt")
+
+
+def load_checkpoint(mode: str, disk: str, state_mount: str = "/mnt") -> Checkpoint:
+    """Read the state left by an earlier run on the remounted target or exit if it cannot be resumed."""
+    try:
+        state = json.loads(STATE_PATH.read_text())
+    except (OSError, json.JSONDecodeError) as e:
+        print(f"Error: cannot resume, no readable install state at {STATE_PATH} ({e}).")
+        print("The earlier run probably failed before the target was mounted; start a fresh install.")
+        sys.exit(1)
+    if state.get("version") != STATE_VERSION or state.get("mode") != mode:
+        print(f"Error: cannot resume a '{state.get('mode')}' install as '{mode}'.")
+        sys.exit(1)
+    if state.get("disk") != disk:
+        print(f"Error: the install state belongs to {state.get('disk')}, not {disk}.")
+        sys.exit(1)
+    completed = set(state.get("completed", []))
+    print(f"Resuming install on {disk}; already completed: {', '.join(sorted(completed))}")
+    return Checkpoint(mode, disk, completed, state_mount)
@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+import subprocess
+import sys
+from pathlib import Path
+
+from .disk_layout import GIB
+from .disk_layout import MIB
+from .library import command_output
+from .library import run_command
+from .library import write_file
+from .mount_layout import MountLayout
+from .mount_layout import Subvolume
+
+SWAP_STRATEGIES = ["partition", "swapfile", "zram", "none"]
+# Its own nodatacow subvolume: btrfs refuses to snapshot a subvolume holding an active swapfile
+SWAP_SUBVOLUME = Subvolume("@swap", "/swap", nodatacow=True)
+SWAPFILE = "/swap/swapfile"
+
+ZRAM_CONFIG = """[zram0]
+zram-size = ram / 2
+compression-algorithm = zstd
+swap-priority = 100
+"""
+
+# zram is far cheaper than disk swap: swap eagerly and skip readahead of neighbouring pages
+ZRAM_SYSCTL = """vm.swappiness = 180
+vm.watermark_boost_factor = 0
+vm.watermark_scale_factor = 125
+vm.page-cluster = 0
+"""
+
+
+def check_swap_strategy(strategy: str, hibernate: bool, swap_gib: float | None, multi_device: bool) -> None:
+    """Reject combinations that cannot work before anything is wiped."""
+    if hibernate and strategy not in {"partition", "swapfile"}:
+        print(f"Error: --hibernate needs disk swap; --swap {strategy} cannot hold a hibernation image.")
+        sys.exit(1)
+    if hibernate and swap_gib == 0:
+        print("Error: --hibernate needs swap; --swap-size 0 disables it.")
+        sys.exit(1)
+    if strategy == "swapfile" and multi_device:
+        print("Error: btrfs only supports swapfiles on a single-device filesystem; use --swap partition or zram.")
+        sys.exit(1)
+
+
+def swap_layout(layout: MountLayout, strategy: str) -> MountLayout:
+    """Add the @swap subvolume to the mount layout when the swapfile strategy is used."""
+    if strategy != "swapfile" or any(s.name == SWAP_SUBVOLUME.name for s in layout.subvolumes):
+        return layout
+    return MountLayout(layout.name, layout.options, layout.subvolumes + [SWAP_SUBVOLUME])
+
+
+def create_swapfile(size_bytes: int) -> None:
+    swapfile = Path("/mnt" + SWAPFILE)
+    if not swapfile.exists():
+        # mkswapfile allocates contiguous nodatacow extents and formats the file in one step
+        run_command(["btrfs", "filesystem", "mkswapfile", "--size", f"{size_bytes // MIB}m", str(swapfile)])
+    # genfstab picks up active swapfiles under /mnt and writes them without the prefix
+    subprocess.run(["swapon", str(swapfile)], check=False)
+
+
+def configure_zram() -> None:
+    write_file(Path("/mnt/etc/systemd/zram-generator.conf"), ZRAM_CONFIG, mode=0o644)
+    write_file(Path("/mnt/etc/sysctl.d/99-vm-zram.conf"), ZRAM_SYSCTL, mode=0o644)
+
+
+def resume_kernel_args(strategy: str, swap: str | None, root: str) -> str:
+    """Kernel parameters that point the initramfs at the hibernation image."""
+    if strategy == "partition":
+        return f"resume=UUID={command_output(['blkid', '-s', 'UUID', '-o', 'value', swap])}"
+    # A swapfile resumes from the filesystem holding it, at the file's physical offset
+    uuid = command_output(["blkid", "-s", "UUID", "-o", "value", root])
+    offset = command_output(["btrfs", "inspect-internal", "map-swapfile", "-r", "/mnt" + SWAPFILE])
+    return f"resume=UUID={uuid} resume_offset={offset}"
+
+
+def describe_swap(strategy: str, size_bytes: int, hibernate: bool) -> str:
+    if strategy == "zram":
+        return "Swap: zram (zstd, half of RAM)"
+    if strategy == "none":
+        return "Swap: none"
+    where = "partition" if strategy == "partition" else f"btrfs swapfile {SWAPFILE}"
+    return f"Swap: {where}, {size_bytes / GIB:.1f} GiB{', hibernation enabled' if hibernate else ''}"
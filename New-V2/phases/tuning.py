@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+import sys
+from dataclasses import dataclass
+from dataclasses import field
+from pathlib import Path
+
+from .disk_layout import MIB
+from .library import write_file
+from .report import REPORT
+
+
+@dataclass
+class Tuning:
+    description: str
+    # Replaces the stock linux (and linux-headers) package; --kernel overrides it
+    kernel: str | None = None
+    # Scheduler per drive class (nvme, ssd, hdd); classes left out keep the kernel default
+    schedulers: dict[str, str] = field(default_factory=dict)
+    # Only applies to disk swap: the zram strategy sets its own, much higher value
+    swappiness: int | None = None
+    sysctl: dict[str, int] = field(default_factory=dict)
+    # "ppd:<profile>" for power-profiles-daemon, "cpupower:<governor>" for a fixed governor
+    cpu: str | None = None
+    irqbalance: bool = False
+
+
+# "stock" changes nothing, so repeated installs compare the same baseline
+TUNING_PROFILES = {
+    "stock": Tuning("Stock kernel, sysctls, I/O schedulers and CPU frequency governor"),
+    "desktop": Tuning(
+        "Interactive desktop: bfq on hard disks, little swapping, small writeback bursts, power-profiles-daemon",
+        schedulers={"nvme": "none", "ssd": "mq-deadline", "hdd": "bfq"},
+        swappiness=10,
+        # Byte limits instead of ratios: on 32 GiB of RAM the default 20% lets a copy
+        # queue gigabytes of dirty pages and stall everything else while they flush
+        sysctl={"vm.dirty_background_bytes": 64 * MIB, "vm.dirty_bytes": 256 * MIB, "vm.vfs_cache_pressure": 50},
+        cpu="ppd:balanced",
+    ),
+    "latency": Tuning(
+        "linux-zen with the desktop settings and the performance power profile",
+        kernel="linux-zen",
+        schedulers={"nvme": "none", "ssd": "mq-deadline", "hdd": "bfq"},
+        swappiness=10,
+        sysctl={"vm.dirty_background_bytes": 32 * MIB, "vm.dirty_bytes": 128 * MIB, "vm.vfs_cache_pressure": 50},
+        cpu="ppd:performance",
+    ),
+    "throughput": Tuning(
+        "linux-lts server: mq-deadline everywhere, large writeback batches, performance governor, irqbalance",
+        kernel="linux-lts",
+        schedulers={"nvme": "none", "ssd": "mq-deadline", "hdd": "mq-deadline"},
+        swappiness=10,
+        sysctl={"vm.dirty_background_ratio": 10, "vm.dirty_ratio": 40, "vm.dirty_expire_centisecs": 6000},
+        cpu="cpupower:performance",
+        irqbalance=True,
+    ),
+}
+DEFAULT_TUNING = "stock"
+
+IO_SCHEDULER_RULES = Path("/mnt/etc/udev/rules.d/60-ioschedulers.rules")
+# Named so that 99-vm-zram.conf, written for --swap zram, still has the last word
+TUNING_SYSCTL = Path("/mnt/etc/sysctl.d/90-installer-tuning.conf")
+POWER_SERVICE = "installer-power-profile.service"
+
+_SCHEDULER_MATCH = {
+    "nvme": 'KERNEL=="nvme[0-9]*n[0-9]*"',
+    "ssd": 'KERNEL=="sd[a-z]*|mmcblk[0-9]*", ATTR{queue/rotational}=="0"',
+    "hdd": 'KERNEL=="sd[a-z]*", ATTR{queue/rotational}=="1"',
+}
+
+# Sets the profile once the daemon runs; power-profiles-daemon then keeps it across boots
+PPD_UNIT = """[Unit]
+Description=Apply the installer's CPU power profile
+After=power-profiles-daemon.service
+Wants=power-profiles-daemon.service
+
+[Service]
+Type=oneshot
+ExecStart=/usr/bin/powerprofilesctl set {profile}
+
+[Install]
+WantedBy=multi-user.target
+"""
+
+# Its own unit rather than cpupower.service: that one's config file moved between
+# package versions, and a file written before pacman installs it would conflict
+CPUPOWER_UNIT = """[Unit]
+Description=Apply the installer's CPU frequency governor
+
+[Service]
+Type=oneshot
+RemainAfterExit=yes
+ExecStart=/usr/bin/cpupower frequency-set -g {governor}
+
+[Install]
+WantedBy=multi-user.target
+"""
+
+
+def get_tuning(name: str) -> Tuning:
+    if name not in TUNING_PROFILES:
+        print(f"Error: unknown tuning profile '{name}'. Available profiles:")
+        for profile_name, tuning in TUNING_PROFILES.items():
+            print(f"  {profile_name}: {tuning.description}")
+        sys.exit(1)
+    return TUNING_PROFILES[name]
+
+
+def _cpu_tool(tuning: Tuning) -> tuple[str, str] | None:
+    if tuning.cpu is None:
+        return None
+    kind, value = tuning.cpu.split(":", 1)
+    return kind, value
+
+
+def tuning_packages(tuning: Tuning, irqbalance: bool) -> list[str]:
+    tool = _cpu_tool(tuning)
+    packages = []
+    if tool is not None:
+        packages.append("power-profiles-daemon" if tool[0] == "ppd" else "cpupower")
+    if irqbalance or tuning.irqbalance:
+        packages.append("irqbalance")
+    return packages
+
+
+def tuning_services(tuning: Tuning, irqbalance: bool) -> list[str]:
+    """Units for the chroot's services step, which runs once the packages above are installed."""
+    tool = _cpu_tool(tuning)
+    services = []
+    if tool is not None:
+        services += (["power-profiles-daemon.service"] if tool[0] == "ppd" else []) + [POWER_SERVICE]
+    if irqbalance or tuning.irqbalance:
+        services.append("irqbalance.service")
+    return services
+
+
+def vm_sysctl(tuning: Tuning, swap_strategy: str) -> dict[str, int]:
+    """The profile's sysctls for this swap strategy.
+
+    swappiness only matters with disk swap; zram brings its own (180), and
+    without swap there is nothing to tune.
+    """
+    settings = dict(tuning.sysctl)
+    if tuning.swappiness is not None and swap_strategy in {"partition", "swapfile"}:
+        settings["vm.swappiness"] = tuning.swappiness
+    return settings
+
+
+def io_scheduler_rules(schedulers: dict[str, str]) -> str:
+    # The name globs also match partitions (nvme0n1p2, sda1), which have no queue/ attributes
+    lines = [f'ACTION=="add|change", SUBSYSTEM=="block", ENV{{DEVTYPE}}=="disk", {_SCHEDULER_MATCH[kind]}, '
+             f'ATTR{{queue/scheduler}}="{scheduler}"'
+             for kind, scheduler in schedulers.items()]
+    return "\n".join(lines) + "\n"
+
+
+def record_tuning(name: str, tuning: Tuning, kernel: str, swap_strategy: str, irqbalance: bool) -> None:
+    """Store the effective profile in the install report, so fleet results compare like with like."""
+    with REPORT.lock:
+        REPORT.extra["tuning"] = {
+            "profile": name,
+            "kernel": kernel,
+            "io_schedulers": tuning.schedulers,
+            "sysctl": vm_sysctl(tuning, swap_strategy),
+            "cpu": tuning.cpu,
+            "irqbalance": irqbalance or tuning.irqbalance,
+        }
+
+
+def _write_or_remove(path: Path, content: str | None) -> None:
+    # A reprovision to another profile must not keep the previous profile's files
+    if content:
+        write_file(path, content, mode=0o644)
+    else:
+        path.unlink(missing_ok=True)
+
+
+def configure_tuning(tuning: Tuning, swap_strategy: str) -> None:
+    """Write the udev rules, sysctls and power unit of a tuning profile into /mnt."""
+    _write_or_remove(IO_SCHEDULER_RULES, io_scheduler_rules(tuning.schedulers) if tuning.schedulers else None)
+    settings = vm_sysctl(tuning, swap_strategy)
+    _write_or_remove(TUNING_SYSCTL, "".join(f"{key} = {value}\n" for key, value in settings.items()))
+    unit = None
+    tool = _cpu_tool(tuning)
+    if tool is not None:
+        kind, value = tool
+        unit = PPD_UNIT.format(profile=value) if kind == "ppd" else CPUPOWER_UNIT.format(governor=value)
+    _write_or_remove(Path("/mnt/etc/systemd/system") / POWER_SERVICE, unit)
@@ -1,27 +1,49 @@
 #!/usr/bin/env python3
 import getpass
 
-
-def prompt_user_inputs():
-    """Prompt the user for all required installation inputs.
-
-    Returns:
-        tuple: (country, username, host_name, user_pass, root_pass, timezone, gpu)
-    """
-    country = input("Enter your country (e.g., Iran): ").strip()
-    username = input("Enter username: ").strip()
-    host_name = input("Enter the hostname: ").strip()
-    user_pass = getpass.getpass("Enter the user password: ")
-    root_pass = getpass.getpass("Enter root password: ")
-    timezone = input("Enter your timezone (e.g., Asia/Tehran): ").strip()
-    gpu = input(
+PROMPTS = {
+    "country": "Enter your country (e.g., Iran): ",
+    "username": "Enter username: ",
+    "hostname": "Enter the hostname: ",
+    "user_pass": "Enter the user password: ",
+    "root_pass": "Enter root password: ",
+    "timezone": "Enter your timezone (e.g., Asia/Tehran): ",
+    "gpu": (
         "Select the graphics driver (0-4):\n"
         "0 -> Mesa (open-source)\n"
         "1 -> NVIDIA (open kernel)\n"
         "2 -> NVIDIA (proprietary)\n"
         "3 -> Intel\n"
         "4 -> VirtualBox\n"
+        "Enter -> detect automatically\n"
         "Your choice: "
-    ).strip()
+    ),
+}
+SECRET_FIELDS = {"user_pass", "root_pass"}
+
+
+def ask(field: str) -> str:
+    """Prompt for one installation input; passwords are read without echo."""
+    if field in SECRET_FIELDS:
+        return getpass.getpass(PROMPTS[field])
+    return input(PROMPTS[field]).strip()
+
+
+def prompt_user_inputs(ask_gpu: bool = True):
+    """Prompt the user for all required installation inputs.
+
+    Args:
+        ask_gpu: Show the graphics driver menu; gpu is None when False.
+
+    Returns:
+        tuple: (country, username, host_name, user_pass, root_pass, timezone, gpu)
+    """
+    country = ask("country")
+    username = ask("username")
+    host_name = ask("hostname")
+    user_pass = ask("user_pass")
+    root_pass = ask("root_pass")
+    timezone = ask("timezone")
+    gpu = ask("gpu") if ask_gpu else None
 
     return country, username, host_name, user_pass, root_pass, timezone, gpu